@@ -11,6 +11,9 @@
 
 #pragma once
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #define arraylen(_array)    \
     ( sizeof(_array) / sizeof(*(_array)) )
 
@@ -19,3 +22,23 @@
 
 #define arrayend(_array)    \
     ( arraybeg(_array) + arraylen(_array) )
+
+/**
+ * Doubles the capacity of a dynamically allocated array; the
+ * program aborts if there's no memory left.
+ */
+static inline void*
+arraygrow(void* array, unsigned long* capacity, size_t size)
+{
+    unsigned long newcap = *capacity ? 2 * *capacity : 64;
+
+    void* newarray = realloc(array, newcap * size);
+    if (!newarray) {
+        perror("realloc");
+        abort(); /* We cannot track the transaction; let's abort for now. */
+    }
+
+    *capacity = newcap;
+
+    return newarray;
+}
@@ -0,0 +1,387 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Bank-transfer benchmark
+ *
+ *  Run
+ *
+ *      make bench
+ *      ./bench-bank [-a ACCOUNTS] [-z SKEWS] [-t THREADS] [-i INTERVAL]
+ *                   [-d SECONDS] [-u]
+ *
+ *  to move money between ACCOUNTS accounts. Each transfer is a
+ *  transaction that picks two accounts and moves a random amount if
+ *  the source's balance covers it. Accounts are picked from a Zipf
+ *  distribution; a skew of 0 picks them uniformly, larger skews
+ *  concentrate transfers on a few hot accounts.
+ *
+ *  Every INTERVAL transfers, a thread audits the bank in a read-only
+ *  transaction that sums up all balances; the sum has to stay at its
+ *  initial value. An interval of 0 disables audits. SKEWS and THREADS
+ *  are comma-separated lists; the benchmark prints a line of CSV for
+ *  each combination.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "tm.h"
+#include "tm-access.h"
+
+#define INITIAL_BALANCE (1000)
+#define MAX_AMOUNT      (100)
+
+struct config {
+    unsigned long naccounts;
+    const char*   skews;
+    const char*   threads;
+    unsigned long audit_interval;
+    double        seconds;
+    bool          pin;
+};
+
+/* Results of a thread */
+struct worker {
+    struct bench_rand rand;
+    unsigned long     ntransfers;
+    unsigned long     naudits;
+    unsigned long     nfailed_audits;
+} __attribute__((aligned(64)));
+
+static struct config     g_config;
+static uint64_t*         g_account;
+/* Cumulative Zipf distribution over the accounts */
+static double*           g_zipf_cdf;
+static struct worker*    g_worker;
+static pthread_barrier_t g_barrier;
+static uint64_t          g_begin_ns;
+static uint64_t          g_deadline_ns;
+
+/* Sets up the Zipf distribution; account i has a probability
+ * proportional to 1 / (i + 1)^skew. Returns 0 on success, or -1
+ * if the skew is so large that only the first account remains. */
+static int
+init_zipf(double skew)
+{
+    double sum = 0;
+
+    unsigned long i;
+    for (i = 0; i < g_config.naccounts; ++i) {
+        sum += 1 / pow(i + 1, skew);
+        g_zipf_cdf[i] = sum;
+    }
+    for (i = 0; i < g_config.naccounts; ++i) {
+        g_zipf_cdf[i] /= sum;
+    }
+
+    return g_zipf_cdf[0] < 1 ? 0 : -1;
+}
+
+/* Returns a uniform random number in [0, 1). */
+static double
+rand_unit(struct bench_rand* rand)
+{
+    return (bench_rand_next(rand) >> 11) * 0x1p-53;
+}
+
+/* Returns the first account with u < cdf. */
+static unsigned long
+find_account(double u)
+{
+    unsigned long lo = 0;
+    unsigned long hi = g_config.naccounts - 1;
+
+    while (lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (u < g_zipf_cdf[mid]) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+}
+
+static unsigned long
+pick_account(struct bench_rand* rand)
+{
+    return find_account(rand_unit(rand));
+}
+
+/* Picks an account other than src, with src's probability
+ * distributed among all others. */
+static unsigned long
+pick_other_account(struct bench_rand* rand, unsigned long src)
+{
+    double lo = src ? g_zipf_cdf[src - 1] : 0;
+    double weight = g_zipf_cdf[src] - lo;
+
+    /* Skip over src's part of the distribution. */
+    double u = rand_unit(rand) * (1 - weight);
+    if (u >= lo) {
+        u += weight;
+    }
+
+    unsigned long dst = find_account(u);
+
+    /* Rounding might still hit src. */
+    return dst != src ? dst : (src + 1) % g_config.naccounts;
+}
+
+/* Moves amount from src to dst; returns false if src doesn't
+ * have enough money. */
+static bool
+transfer(uint64_t* src, uint64_t* dst, uint64_t amount)
+{
+    tm_save bool done = false;
+
+    tm_begin
+        uint64_t balance = tm_load_u64(src);
+        if (balance >= amount) {
+            tm_store_u64(src, balance - amount);
+            tm_store_u64(dst, tm_load_u64(dst) + amount);
+            done = true;
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+
+    return done;
+}
+
+/* Returns the sum of all balances. */
+static uint64_t
+audit(void)
+{
+    tm_save uint64_t total = 0;
+
+    tm_begin
+        uint64_t sum = 0;
+        unsigned long i;
+        for (i = 0; i < g_config.naccounts; ++i) {
+            sum += tm_load_u64(g_account + i);
+        }
+        total = sum;
+    tm_commit
+        tm_restart();
+    tm_end
+
+    return total;
+}
+
+static void
+worker_func(unsigned long index, void* arg)
+{
+    struct worker* worker = g_worker + index;
+
+    if (bench_barrier_wait(&g_barrier)) {
+        g_begin_ns = bench_now_ns();
+        g_deadline_ns = g_begin_ns + (uint64_t)(g_config.seconds * 1e9);
+    }
+    bench_barrier_wait(&g_barrier);
+
+    uint64_t deadline_ns = g_deadline_ns;
+    uint64_t expected = (uint64_t)g_config.naccounts * INITIAL_BALANCE;
+
+    unsigned long until_audit = g_config.audit_interval;
+
+    do {
+        unsigned long i;
+        for (i = 0; i < 64; ++i) {
+
+            unsigned long src = pick_account(&worker->rand);
+            unsigned long dst = pick_other_account(&worker->rand, src);
+            uint64_t amount = bench_rand_below(&worker->rand, MAX_AMOUNT) + 1;
+
+            transfer(g_account + src, g_account + dst, amount);
+
+            if (until_audit && !--until_audit) {
+                worker->nfailed_audits += audit() != expected;
+                ++worker->naudits;
+                until_audit = g_config.audit_interval;
+            }
+        }
+        worker->ntransfers += i;
+
+    } while (bench_now_ns() < deadline_ns);
+}
+
+/* Runs one combination and prints its results. Returns 0 on
+ * success, or -1 if an audit failed. */
+static int
+run_bench(double skew, unsigned long nthreads)
+{
+    unsigned long i;
+    for (i = 0; i < g_config.naccounts; ++i) {
+        g_account[i] = INITIAL_BALANCE;
+    }
+
+    g_worker = bench_calloc_aligned(nthreads, sizeof(*g_worker),
+                                    __alignof__(*g_worker));
+
+    for (i = 0; i < nthreads; ++i) {
+        bench_rand_init(&g_worker[i].rand, i + 1);
+    }
+
+    int err = pthread_barrier_init(&g_barrier, NULL, nthreads);
+    if (err) {
+        errno = err;
+        perror("pthread_barrier_init");
+        abort();
+    }
+
+    unsigned long aborts = bench_total_aborts(NULL);
+
+    bench_run_threads(nthreads, g_config.pin, worker_func, NULL);
+
+    uint64_t end_ns = bench_now_ns();
+
+    aborts = bench_total_aborts(NULL) - aborts;
+
+    pthread_barrier_destroy(&g_barrier);
+
+    unsigned long ntransfers = 0;
+    unsigned long naudits = 0;
+    unsigned long nfailed_audits = 0;
+
+    for (i = 0; i < nthreads; ++i) {
+        ntransfers += g_worker[i].ntransfers;
+        naudits += g_worker[i].naudits;
+        nfailed_audits += g_worker[i].nfailed_audits;
+    }
+
+    /* A final audit after all threads finished */
+    uint64_t sum = 0;
+    for (i = 0; i < g_config.naccounts; ++i) {
+        sum += g_account[i];
+    }
+    nfailed_audits += sum != (uint64_t)g_config.naccounts * INITIAL_BALANCE;
+
+    double seconds = (end_ns - g_begin_ns) / 1e9;
+    unsigned long commits = ntransfers + naudits;
+
+    printf("%.2f,%lu,%lu,%.3f,%lu,%.0f,%lu,%lu,%.4f,%s\n",
+           skew, nthreads, g_config.naccounts, seconds,
+           ntransfers, ntransfers / seconds, naudits,
+           aborts, commits + aborts ? (double)aborts / (commits + aborts) : 0,
+           nfailed_audits ? "FAILED" : "ok");
+    fflush(stdout);
+
+    free(g_worker);
+
+    return nfailed_audits ? -1 : 0;
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-a ACCOUNTS] [-z SKEWS] [-t THREADS] [-i INTERVAL]\n"
+            "          [-d SECONDS] [-u]\n",
+            prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    g_config.naccounts = 1024;
+    g_config.skews = "0,0.5,0.9,0.99";
+    g_config.threads = "1,2,4,8";
+    g_config.audit_interval = 1024;
+    g_config.seconds = 1;
+    g_config.pin = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:z:t:i:d:uh")) != -1) {
+        switch (opt) {
+            case 'a':
+                g_config.naccounts = strtoul(optarg, NULL, 0);
+                break;
+            case 'z':
+                g_config.skews = optarg;
+                break;
+            case 't':
+                g_config.threads = optarg;
+                break;
+            case 'i':
+                g_config.audit_interval = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                g_config.seconds = strtod(optarg, NULL);
+                break;
+            case 'u':
+                g_config.pin = false;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if ((g_config.naccounts < 2) || (g_config.seconds <= 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    g_account = bench_calloc(g_config.naccounts, sizeof(*g_account));
+    g_zipf_cdf = bench_calloc(g_config.naccounts, sizeof(*g_zipf_cdf));
+
+    printf("skew,threads,accounts,seconds,transfers,transfers_per_sec,"
+           "audits,aborts,abort_ratio,audit\n");
+
+    int res = EXIT_SUCCESS;
+
+    const char* skews = g_config.skews;
+
+    while (*skews) {
+        char* end;
+        double skew = strtod(skews, &end);
+        if ((end == skews) || (skew < 0)) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (init_zipf(skew) < 0) {
+            fprintf(stderr, "%s: skew %g leaves a single account\n", argv[0], skew);
+            return EXIT_FAILURE;
+        }
+
+        const char* threads = g_config.threads;
+
+        while (*threads) {
+            char* end;
+            unsigned long nthreads = strtoul(threads, &end, 0);
+            if ((end == threads) || !nthreads) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+
+            if (run_bench(skew, nthreads) < 0) {
+                res = EXIT_FAILURE;
+            }
+
+            threads = *end == ',' ? end + 1 : end;
+        }
+
+        skews = *end == ',' ? end + 1 : end;
+    }
+
+    free(g_zipf_cdf);
+    free(g_account);
+
+    return res;
+}
@@ -0,0 +1,299 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Open-loop latency benchmark
+ *
+ *  Run
+ *
+ *      make bench
+ *      ./bench-latency [-r RATES] [-t THREADS] [-m WORDS] [-k WRITES]
+ *                      [-d SECONDS] [-u]
+ *
+ *  to measure transaction latency at fixed offered loads. For each
+ *  rate in the comma-separated list RATES, THREADS threads together
+ *  issue RATES transactions per second for SECONDS seconds. Each
+ *  transaction increments WRITES random words out of WORDS shared
+ *  words.
+ *
+ *  Requests are scheduled at fixed intervals. A thread that falls
+ *  behind doesn't push back its schedule; it sends its pending
+ *  requests as fast as it can. Each request's latency runs from its
+ *  scheduled send time to its commit, so the time it queued behind
+ *  slow requests counts. Closed-loop measurements omit exactly that
+ *  time. The output shows these corrected percentiles next to the
+ *  uncorrected ones, which only measure from the actual send time.
+ *
+ *  Requests that are still pending after another SECONDS seconds
+ *  are not sent; they count with their waiting time so far. Latencies
+ *  are in microseconds.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "histogram.h"
+#include "tm.h"
+#include "tm-access.h"
+
+/* Writes per transaction, at most */
+#define MAX_WRITES  (64)
+
+struct config {
+    const char*   rates;
+    unsigned long nthreads;
+    unsigned long nwords;
+    unsigned long nwrites;
+    double        seconds;
+    bool          pin;
+};
+
+/* Results of a thread */
+struct worker {
+    struct bench_rand rand;
+    unsigned long     nrequests;
+    unsigned long     nunsent;
+    uint64_t          last_commit_ns;
+    /* From scheduled and actual send time to commit */
+    struct histogram  corrected;
+    struct histogram  uncorrected;
+} __attribute__((aligned(64)));
+
+static struct config     g_config;
+static uint64_t*         g_word;
+static struct worker*    g_worker;
+static pthread_barrier_t g_barrier;
+static double            g_rate;
+static uint64_t          g_begin_ns;
+
+static void
+run_request(struct bench_rand* rand)
+{
+    uint64_t* word[MAX_WRITES];
+
+    unsigned long i;
+    for (i = 0; i < g_config.nwrites; ++i) {
+        word[i] = g_word + bench_rand_below(rand, g_config.nwords);
+    }
+
+    tm_begin
+        unsigned long i;
+        for (i = 0; i < g_config.nwrites; ++i) {
+            tm_store_u64(word[i], tm_load_u64(word[i]) + 1);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static void
+worker_func(unsigned long index, void* arg)
+{
+    struct worker* worker = g_worker + index;
+
+    if (bench_barrier_wait(&g_barrier)) {
+        /* Leave the threads some time to reach their first
+         * request. */
+        g_begin_ns = bench_now_ns() + 1000000;
+    }
+    bench_barrier_wait(&g_barrier);
+
+    uint64_t duration_ns = (uint64_t)(g_config.seconds * 1e9);
+    uint64_t deadline_ns = g_begin_ns + duration_ns;
+    uint64_t stop_ns = deadline_ns + duration_ns;
+
+    /* Each thread sends every nthreads-th request of the
+     * overall schedule. */
+    double interval_ns = 1e9 / g_rate;
+
+    unsigned long i;
+    for (i = index; ; i += g_config.nthreads) {
+
+        uint64_t scheduled_ns = g_begin_ns + (uint64_t)(i * interval_ns);
+        if (scheduled_ns >= deadline_ns) {
+            break;
+        }
+
+        uint64_t sent_ns = bench_now_ns();
+
+        if (sent_ns >= stop_ns) {
+            histogram_record(&worker->corrected, sent_ns - scheduled_ns);
+            ++worker->nunsent;
+            continue;
+        } else if (sent_ns < scheduled_ns) {
+            bench_wait_until_ns(scheduled_ns);
+            sent_ns = bench_now_ns();
+        }
+
+        run_request(&worker->rand);
+
+        uint64_t commit_ns = bench_now_ns();
+
+        histogram_record(&worker->corrected, commit_ns - scheduled_ns);
+        histogram_record(&worker->uncorrected, commit_ns - sent_ns);
+
+        ++worker->nrequests;
+        worker->last_commit_ns = commit_ns;
+    }
+}
+
+static double
+percentile_us(const struct histogram* hist, double fraction)
+{
+    return histogram_percentile(hist, fraction) / 1e3;
+}
+
+/* Runs one offered load and prints its results. */
+static void
+run_bench(double rate)
+{
+    g_rate = rate;
+
+    g_worker = bench_calloc_aligned(g_config.nthreads, sizeof(*g_worker),
+                                    __alignof__(*g_worker));
+
+    unsigned long i;
+    for (i = 0; i < g_config.nthreads; ++i) {
+        bench_rand_init(&g_worker[i].rand, i + 1);
+    }
+
+    int err = pthread_barrier_init(&g_barrier, NULL, g_config.nthreads);
+    if (err) {
+        errno = err;
+        perror("pthread_barrier_init");
+        abort();
+    }
+
+    unsigned long aborts = bench_total_aborts(NULL);
+
+    bench_run_threads(g_config.nthreads, g_config.pin, worker_func, NULL);
+
+    aborts = bench_total_aborts(NULL) - aborts;
+
+    pthread_barrier_destroy(&g_barrier);
+
+    struct histogram corrected;
+    struct histogram uncorrected;
+    memset(&corrected, 0, sizeof(corrected));
+    memset(&uncorrected, 0, sizeof(uncorrected));
+
+    unsigned long nrequests = 0;
+    unsigned long nunsent = 0;
+    uint64_t end_ns = g_begin_ns;
+
+    for (i = 0; i < g_config.nthreads; ++i) {
+        const struct worker* worker = g_worker + i;
+        histogram_merge(&corrected, &worker->corrected);
+        histogram_merge(&uncorrected, &worker->uncorrected);
+        nrequests += worker->nrequests;
+        nunsent += worker->nunsent;
+        if (worker->last_commit_ns > end_ns) {
+            end_ns = worker->last_commit_ns;
+        }
+    }
+
+    double seconds = (end_ns - g_begin_ns) / 1e9;
+
+    printf("%.0f,%.0f,%lu,%lu,%lu,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+           rate, seconds > 0 ? nrequests / seconds : 0, g_config.nthreads,
+           nrequests, nunsent, aborts,
+           percentile_us(&corrected, 0.5),
+           percentile_us(&corrected, 0.99),
+           percentile_us(&corrected, 0.999),
+           corrected.max / 1e3,
+           percentile_us(&uncorrected, 0.99),
+           percentile_us(&uncorrected, 0.999));
+    fflush(stdout);
+
+    free(g_worker);
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-r RATES] [-t THREADS] [-m WORDS] [-k WRITES]\n"
+            "          [-d SECONDS] [-u]\n",
+            prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    g_config.rates = "10000,50000,100000,200000,400000,800000";
+    g_config.nthreads = 2;
+    g_config.nwords = 4096;
+    g_config.nwrites = 4;
+    g_config.seconds = 1;
+    g_config.pin = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:m:k:d:uh")) != -1) {
+        switch (opt) {
+            case 'r':
+                g_config.rates = optarg;
+                break;
+            case 't':
+                g_config.nthreads = strtoul(optarg, NULL, 0);
+                break;
+            case 'm':
+                g_config.nwords = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                g_config.nwrites = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                g_config.seconds = strtod(optarg, NULL);
+                break;
+            case 'u':
+                g_config.pin = false;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (!g_config.nthreads || !g_config.nwords ||
+        (g_config.nwrites > MAX_WRITES) || (g_config.seconds <= 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    g_word = bench_calloc(g_config.nwords, sizeof(*g_word));
+
+    printf("offered_per_sec,achieved_per_sec,threads,requests,unsent,aborts,"
+           "p50_us,p99_us,p999_us,max_us,uncorrected_p99_us,uncorrected_p999_us\n");
+
+    const char* rates = g_config.rates;
+
+    while (*rates) {
+        char* end;
+        double rate = strtod(rates, &end);
+        if ((end == rates) || (rate <= 0)) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        run_bench(rate);
+
+        rates = *end == ',' ? end + 1 : end;
+    }
+
+    free(g_word);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,453 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Per-operation overhead of the transactional-memory API
+ *
+ *  Run
+ *
+ *      make bench
+ *      ./bench-ops [-t THREADS] [-s SAMPLES] [-n OPS] [-w WARMUPS] [-u]
+ *                  [OPERATION...]
+ *
+ *  to measure nanoseconds per load(), store(), privatize(),
+ *  malloc_tx(), free_tx(), empty transaction and abort with restart.
+ *  Each thread runs all benchmarks on its own memory, so the numbers
+ *  show instrumentation overhead rather than conflicts. Loads, stores
+ *  and privatizations run in batches of BATCH_NOPS per transaction,
+ *  allocations in batches of BATCH_NBLOCKS, so their numbers include
+ *  a share of tm_begin and tm_commit.
+ *
+ *  Each sample is the average of OPS operations after WARMUPS
+ *  unmeasured samples. The output shows the median of all threads'
+ *  samples and its 95% confidence interval in nanoseconds.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "stdlib-tx.h"
+#include "tm.h"
+
+/* Accesses per transaction, each to its own STRIDE bytes */
+#define BATCH_NOPS      (16)
+#define STRIDE          (1024)
+
+/* Allocations per transaction */
+#define BATCH_NBLOCKS   (64)
+
+struct config {
+    unsigned long nthreads;
+    unsigned long nsamples;
+    unsigned long nwarmups;
+    unsigned long nops;
+    bool          pin;
+    char**        filter;
+    int           nfilters;
+};
+
+/* Per-thread memory */
+struct context {
+    uint8_t* mem;
+    uint8_t  buf[STRIDE];
+    void*    block[BATCH_NBLOCKS];
+};
+
+/* Each benchmark runs nops operations and returns the
+ * nanoseconds they took. */
+typedef uint64_t (*bench_func)(struct context* ctx, size_t size,
+                               size_t offset, unsigned long nops);
+
+static uint64_t
+bench_load(struct context* ctx, size_t size, size_t offset, unsigned long nops)
+{
+    uint64_t beg = bench_now_ns();
+
+    unsigned long i;
+    for (i = 0; i < nops; i += BATCH_NOPS) {
+        tm_begin
+            unsigned long j;
+            for (j = 0; j < BATCH_NOPS; ++j) {
+                load((uintptr_t)(ctx->mem + j * STRIDE + offset), ctx->buf, size);
+            }
+        tm_commit
+            tm_restart();
+        tm_end
+    }
+
+    return bench_now_ns() - beg;
+}
+
+static uint64_t
+bench_store(struct context* ctx, size_t size, size_t offset, unsigned long nops)
+{
+    uint64_t beg = bench_now_ns();
+
+    unsigned long i;
+    for (i = 0; i < nops; i += BATCH_NOPS) {
+        tm_begin
+            unsigned long j;
+            for (j = 0; j < BATCH_NOPS; ++j) {
+                store((uintptr_t)(ctx->mem + j * STRIDE + offset), ctx->buf, size);
+            }
+        tm_commit
+            tm_restart();
+        tm_end
+    }
+
+    return bench_now_ns() - beg;
+}
+
+static uint64_t
+bench_privatize(struct context* ctx, size_t size, size_t offset,
+                unsigned long nops)
+{
+    uint64_t beg = bench_now_ns();
+
+    unsigned long i;
+    for (i = 0; i < nops; i += BATCH_NOPS) {
+        tm_begin
+            unsigned long j;
+            for (j = 0; j < BATCH_NOPS; ++j) {
+                privatize((uintptr_t)(ctx->mem + j * STRIDE + offset), size,
+                          true, true);
+            }
+        tm_commit
+            tm_restart();
+        tm_end
+    }
+
+    return bench_now_ns() - beg;
+}
+
+static void
+malloc_blocks(struct context* ctx, size_t size)
+{
+    tm_begin
+        unsigned long j;
+        for (j = 0; j < BATCH_NBLOCKS; ++j) {
+            ctx->block[j] = malloc_tx(size);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static void
+free_blocks(struct context* ctx)
+{
+    tm_begin
+        unsigned long j;
+        for (j = 0; j < BATCH_NBLOCKS; ++j) {
+            free_tx(ctx->block[j]);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static uint64_t
+bench_malloc_tx(struct context* ctx, size_t size, size_t offset,
+                unsigned long nops)
+{
+    uint64_t ns = 0;
+
+    unsigned long i;
+    for (i = 0; i < nops; i += BATCH_NBLOCKS) {
+        uint64_t beg = bench_now_ns();
+        malloc_blocks(ctx, size);
+        ns += bench_now_ns() - beg;
+
+        free_blocks(ctx);
+    }
+
+    return ns;
+}
+
+static uint64_t
+bench_free_tx(struct context* ctx, size_t size, size_t offset,
+              unsigned long nops)
+{
+    uint64_t ns = 0;
+
+    unsigned long i;
+    for (i = 0; i < nops; i += BATCH_NBLOCKS) {
+        malloc_blocks(ctx, size);
+
+        uint64_t beg = bench_now_ns();
+        free_blocks(ctx);
+        ns += bench_now_ns() - beg;
+    }
+
+    return ns;
+}
+
+static uint64_t
+bench_empty(struct context* ctx, size_t size, size_t offset,
+            unsigned long nops)
+{
+    uint64_t beg = bench_now_ns();
+
+    unsigned long i;
+    for (i = 0; i < nops; ++i) {
+        tm_begin
+        tm_commit
+            tm_restart();
+        tm_end
+    }
+
+    return bench_now_ns() - beg;
+}
+
+static uint64_t
+bench_restart(struct context* ctx, size_t size, size_t offset,
+              unsigned long nops)
+{
+    uint64_t beg = bench_now_ns();
+
+    unsigned long i;
+    for (i = 0; i < nops; ++i) {
+
+        tm_save bool restarted = false;
+
+        tm_begin
+            if (!restarted) {
+                restarted = true;
+                tm_restart();
+            }
+        tm_commit
+            tm_restart();
+        tm_end
+    }
+
+    return bench_now_ns() - beg;
+}
+
+static const size_t g_access_size[] = {1, 8, 64, 512};
+static const size_t g_access_offset[] = {0, 1};
+static const size_t g_block_size[] = {16, 64, 256, 1024, 4096};
+static const size_t g_no_size[] = {0};
+
+static const struct benchmark {
+    const char*   name;
+    bench_func    func;
+    const size_t* size;
+    unsigned long nsizes;
+    const size_t* offset;
+    unsigned long noffsets;
+} g_benchmark[] = {
+#define ACCESS_BENCH(_name, _func)                              \
+    {_name, _func,                                              \
+     g_access_size, sizeof(g_access_size) / sizeof(size_t),     \
+     g_access_offset, sizeof(g_access_offset) / sizeof(size_t)}
+#define BLOCK_BENCH(_name, _func)                               \
+    {_name, _func,                                              \
+     g_block_size, sizeof(g_block_size) / sizeof(size_t),       \
+     g_no_size, 1}
+#define PLAIN_BENCH(_name, _func)                               \
+    {_name, _func, g_no_size, 1, g_no_size, 1}
+    ACCESS_BENCH("load", bench_load),
+    ACCESS_BENCH("store", bench_store),
+    ACCESS_BENCH("privatize", bench_privatize),
+    BLOCK_BENCH("malloc_tx", bench_malloc_tx),
+    BLOCK_BENCH("free_tx", bench_free_tx),
+    PLAIN_BENCH("empty", bench_empty),
+    PLAIN_BENCH("restart", bench_restart)
+#undef ACCESS_BENCH
+#undef BLOCK_BENCH
+#undef PLAIN_BENCH
+};
+
+static struct config      g_config;
+static pthread_barrier_t  g_barrier;
+
+/* Samples of the current benchmark, nsamples per thread */
+static double*            g_sample;
+
+static bool
+is_selected(const char* name)
+{
+    if (!g_config.nfilters) {
+        return true;
+    }
+
+    int i;
+    for (i = 0; i < g_config.nfilters; ++i) {
+        if (!strcmp(g_config.filter[i], name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+print_summary(const struct benchmark* bench, size_t size, size_t offset)
+{
+    struct bench_summary summary;
+    bench_summarize(g_sample, g_config.nthreads * g_config.nsamples, &summary);
+
+    char size_str[32] = "-";
+    char offset_str[32] = "-";
+
+    if (bench->size != g_no_size) {
+        snprintf(size_str, sizeof(size_str), "%zu", size);
+    }
+    if (bench->offset != g_no_size) {
+        snprintf(offset_str, sizeof(offset_str), "%zu", offset);
+    }
+
+    printf("%-10s %6s %6s %10.2f %10.2f %10.2f\n", bench->name,
+           size_str, offset_str, summary.median, summary.lo, summary.hi);
+}
+
+static void
+run_benchmarks(unsigned long index, void* arg)
+{
+    struct context* ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        perror("calloc");
+        abort();
+    }
+
+    ctx->mem = bench_calloc_aligned(BATCH_NOPS, STRIDE, 64);
+
+    double* sample = g_sample + index * g_config.nsamples;
+
+    const struct benchmark* bench = g_benchmark;
+    const struct benchmark* end = g_benchmark +
+        sizeof(g_benchmark) / sizeof(g_benchmark[0]);
+
+    for (; bench < end; ++bench) {
+
+        if (!is_selected(bench->name)) {
+            continue;
+        }
+
+        unsigned long i, j, k;
+        for (i = 0; i < bench->nsizes; ++i) {
+            for (j = 0; j < bench->noffsets; ++j) {
+
+                size_t size = bench->size[i];
+                size_t offset = bench->offset[j];
+
+                bench_barrier_wait(&g_barrier);
+
+                for (k = 0; k < g_config.nwarmups; ++k) {
+                    bench->func(ctx, size, offset, g_config.nops);
+                }
+                for (k = 0; k < g_config.nsamples; ++k) {
+                    uint64_t ns = bench->func(ctx, size, offset, g_config.nops);
+                    sample[k] = (double)ns / g_config.nops;
+                }
+
+                bench_barrier_wait(&g_barrier);
+
+                if (!index) {
+                    print_summary(bench, size, offset);
+                }
+            }
+        }
+    }
+
+    free(ctx->mem);
+    free(ctx);
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-t THREADS] [-s SAMPLES] [-n OPS] [-w WARMUPS] [-u]\n"
+            "          [OPERATION...]\n"
+            "Operations: load store privatize malloc_tx free_tx empty restart\n",
+            prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    g_config.nthreads = 1;
+    g_config.nsamples = 21;
+    g_config.nwarmups = 3;
+    g_config.nops = 1 << 14;
+    g_config.pin = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:n:w:uh")) != -1) {
+        switch (opt) {
+            case 't':
+                g_config.nthreads = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                g_config.nsamples = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                g_config.nops = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                g_config.nwarmups = strtoul(optarg, NULL, 0);
+                break;
+            case 'u':
+                g_config.pin = false;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Whole batches only */
+    g_config.nops = (g_config.nops + BATCH_NBLOCKS - 1) & ~(BATCH_NBLOCKS - 1ul);
+
+    if (!g_config.nthreads || !g_config.nsamples || !g_config.nops) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    g_config.filter = argv + optind;
+    g_config.nfilters = argc - optind;
+
+    g_sample = calloc(g_config.nthreads * g_config.nsamples, sizeof(*g_sample));
+    if (!g_sample) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    int err = pthread_barrier_init(&g_barrier, NULL, g_config.nthreads);
+    if (err) {
+        errno = err;
+        perror("pthread_barrier_init");
+        goto err_pthread_barrier_init;
+    }
+
+    printf("# %lu thread(s)%s, %lu samples of %lu operations, %lu warm-ups\n",
+           g_config.nthreads, g_config.pin ? " pinned" : "",
+           g_config.nsamples, g_config.nops, g_config.nwarmups);
+    printf("%-10s %6s %6s %10s %10s %10s\n", "operation", "size", "offset",
+           "median/ns", "ci95-lo", "ci95-hi");
+
+    bench_run_threads(g_config.nthreads, g_config.pin, run_benchmarks, NULL);
+
+    pthread_barrier_destroy(&g_barrier);
+    free(g_sample);
+
+    return EXIT_SUCCESS;
+
+err_pthread_barrier_init:
+    free(g_sample);
+    return EXIT_FAILURE;
+}
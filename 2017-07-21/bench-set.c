@@ -0,0 +1,384 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Integer-set benchmark
+ *
+ *  Run
+ *
+ *      make bench
+ *      ./bench-set [-s SETS] [-m MODES] [-t THREADS] [-k KEY_RANGE]
+ *                  [-p UPDATE_PERCENT] [-d SECONDS] [-u]
+ *
+ *  to measure throughput of a hash set, a sorted list, a red-black
+ *  tree and a skip list. Each operation picks a random key below
+ *  KEY_RANGE; UPDATE_PERCENT of the operations are inserts and
+ *  removes in equal parts, all others are lookups. Sets start half
+ *  full.
+ *
+ *  Operations run as transactions ('tm'), under a global mutex
+ *  ('mutex'), or under a global reader-writer lock ('rwlock'), where
+ *  lookups take the lock for reading. SETS, MODES and THREADS are
+ *  comma-separated lists; the benchmark runs all combinations and
+ *  prints a line of CSV for each. Afterwards, it verifies each set's
+ *  structure and size.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "set.h"
+#include "tm.h"
+
+enum mode {
+    MODE_TM,
+    MODE_MUTEX,
+    MODE_RWLOCK,
+    NMODES
+};
+
+static const char* const g_mode_name[NMODES] = {
+    "tm",
+    "mutex",
+    "rwlock"
+};
+
+static const struct set_type* const g_set_type[] = {
+    &g_set_hash,
+    &g_set_list,
+    &g_set_rbtree,
+    &g_set_skiplist
+};
+
+struct config {
+    const char*   sets;
+    const char*   modes;
+    const char*   threads;
+    uint64_t      key_range;
+    unsigned long update_percent;
+    double        seconds;
+    bool          pin;
+};
+
+/* Results of a thread */
+struct worker {
+    struct bench_rand rand;
+    unsigned long     nops;
+    long              nkeys_delta;
+} __attribute__((aligned(64)));
+
+static struct config         g_config;
+static const struct set_type* g_type;
+static enum mode             g_mode;
+static void*                 g_set;
+static struct worker*        g_worker;
+static pthread_barrier_t     g_barrier;
+static pthread_mutex_t       g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t      g_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static uint64_t              g_begin_ns;
+static uint64_t              g_deadline_ns;
+
+static void
+lock(bool update)
+{
+    int err;
+
+    if (g_mode == MODE_MUTEX) {
+        err = pthread_mutex_lock(&g_mutex);
+    } else if (update) {
+        err = pthread_rwlock_wrlock(&g_rwlock);
+    } else {
+        err = pthread_rwlock_rdlock(&g_rwlock);
+    }
+
+    if (err) {
+        errno = err;
+        perror("lock");
+        abort();
+    }
+}
+
+static void
+unlock(void)
+{
+    int err = g_mode == MODE_MUTEX ? pthread_mutex_unlock(&g_mutex)
+                                   : pthread_rwlock_unlock(&g_rwlock);
+    if (err) {
+        errno = err;
+        perror("unlock");
+        abort();
+    }
+}
+
+static bool
+run_tx(bool (*op)(void*, uint64_t), uint64_t key)
+{
+    tm_save bool res = false;
+
+    tm_begin
+        res = op(g_set, key);
+    tm_commit
+        tm_restart();
+    tm_end
+
+    return res;
+}
+
+/* Runs an operation in the current mode; returns true if the
+ * operation found, inserted or removed the key. */
+static bool
+run_op(bool (*tx_op)(void*, uint64_t), bool (*plain_op)(void*, uint64_t),
+       uint64_t key, bool update)
+{
+    if (g_mode == MODE_TM) {
+        return run_tx(tx_op, key);
+    }
+
+    lock(update);
+    bool res = plain_op(g_set, key);
+    unlock();
+
+    return res;
+}
+
+static void
+wait_for_threads(void)
+{
+    if (bench_barrier_wait(&g_barrier)) {
+        g_begin_ns = bench_now_ns();
+        g_deadline_ns = g_begin_ns + (uint64_t)(g_config.seconds * 1e9);
+    }
+    bench_barrier_wait(&g_barrier);
+}
+
+static void
+worker_func(unsigned long index, void* arg)
+{
+    struct worker* worker = g_worker + index;
+
+    const struct set_ops* tx = &g_type->tx;
+    const struct set_ops* plain = &g_type->plain;
+
+    wait_for_threads();
+
+    uint64_t deadline_ns = g_deadline_ns;
+
+    do {
+        unsigned long i;
+        for (i = 0; i < 64; ++i) {
+
+            uint64_t key = bench_rand_below(&worker->rand, g_config.key_range);
+            unsigned long percent = bench_rand_below(&worker->rand, 200);
+
+            if (percent < g_config.update_percent) {
+                worker->nkeys_delta +=
+                    run_op(tx->insert, plain->insert, key, true);
+            } else if (percent < 2 * g_config.update_percent) {
+                worker->nkeys_delta -=
+                    run_op(tx->remove, plain->remove, key, true);
+            } else {
+                run_op(tx->contains, plain->contains, key, false);
+            }
+        }
+        worker->nops += i;
+
+    } while (bench_now_ns() < deadline_ns);
+}
+
+/* Runs one combination and prints its results. Returns 0 on
+ * success, or -1 if the set is broken. */
+static int
+run_bench(const struct set_type* type, enum mode mode, unsigned long nthreads)
+{
+    g_type = type;
+    g_mode = mode;
+    g_set = type->create(g_config.key_range);
+
+    /* Fill the set halfway. */
+    struct bench_rand rand;
+    bench_rand_init(&rand, 0);
+
+    long nkeys = 0;
+    while (nkeys < (long)(g_config.key_range / 2)) {
+        nkeys += type->plain.insert(g_set,
+                                    bench_rand_below(&rand, g_config.key_range));
+    }
+
+    g_worker = bench_calloc_aligned(nthreads, sizeof(*g_worker),
+                                    __alignof__(*g_worker));
+
+    unsigned long i;
+    for (i = 0; i < nthreads; ++i) {
+        bench_rand_init(&g_worker[i].rand, i + 1);
+    }
+
+    int err = pthread_barrier_init(&g_barrier, NULL, nthreads);
+    if (err) {
+        errno = err;
+        perror("pthread_barrier_init");
+        abort();
+    }
+
+    unsigned long aborts = bench_total_aborts(NULL);
+
+    bench_run_threads(nthreads, g_config.pin, worker_func, NULL);
+
+    uint64_t end_ns = bench_now_ns();
+
+    aborts = bench_total_aborts(NULL) - aborts;
+
+    pthread_barrier_destroy(&g_barrier);
+
+    unsigned long nops = 0;
+    for (i = 0; i < nthreads; ++i) {
+        nops += g_worker[i].nops;
+        nkeys += g_worker[i].nkeys_delta;
+    }
+
+    double seconds = (end_ns - g_begin_ns) / 1e9;
+
+    long size = type->verify(g_set);
+
+    printf("%s,%s,%lu,%lu,%lu,%.3f,%lu,%.0f,%lu,%.4f,%ld,%s\n",
+           type->name, g_mode_name[mode], nthreads, (unsigned long)g_config.key_range,
+           g_config.update_percent, seconds, nops, nops / seconds,
+           aborts, nops + aborts ? (double)aborts / (nops + aborts) : 0,
+           size, size == nkeys ? "ok" : "FAILED");
+    fflush(stdout);
+
+    free(g_worker);
+    type->destroy(g_set);
+
+    return size == nkeys ? 0 : -1;
+}
+
+/* Returns true if name is in the comma-separated list. */
+static bool
+in_list(const char* list, const char* name)
+{
+    size_t len = strlen(name);
+
+    while (*list) {
+        const char* end = strchr(list, ',');
+        if (!end) {
+            end = list + strlen(list);
+        }
+        if ((end - list == len) && !strncmp(list, name, len)) {
+            return true;
+        }
+        list = *end ? end + 1 : end;
+    }
+
+    return false;
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-s SETS] [-m MODES] [-t THREADS] [-k KEY_RANGE]\n"
+            "          [-p UPDATE_PERCENT] [-d SECONDS] [-u]\n"
+            "Sets: hash,list,rbtree,skiplist; modes: tm,mutex,rwlock\n",
+            prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    g_config.sets = "hash,list,rbtree,skiplist";
+    g_config.modes = "tm,mutex,rwlock";
+    g_config.threads = "1,2,4,8";
+    g_config.key_range = 1024;
+    g_config.update_percent = 20;
+    g_config.seconds = 1;
+    g_config.pin = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:m:t:k:p:d:uh")) != -1) {
+        switch (opt) {
+            case 's':
+                g_config.sets = optarg;
+                break;
+            case 'm':
+                g_config.modes = optarg;
+                break;
+            case 't':
+                g_config.threads = optarg;
+                break;
+            case 'k':
+                g_config.key_range = strtoull(optarg, NULL, 0);
+                break;
+            case 'p':
+                g_config.update_percent = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                g_config.seconds = strtod(optarg, NULL);
+                break;
+            case 'u':
+                g_config.pin = false;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if ((g_config.key_range < 2) || (g_config.update_percent > 100) ||
+        (g_config.seconds <= 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("set,mode,threads,key_range,update_percent,seconds,ops,"
+           "ops_per_sec,aborts,abort_ratio,size,verified\n");
+
+    int res = EXIT_SUCCESS;
+
+    unsigned long i;
+    for (i = 0; i < sizeof(g_set_type) / sizeof(g_set_type[0]); ++i) {
+
+        if (!in_list(g_config.sets, g_set_type[i]->name)) {
+            continue;
+        }
+
+        enum mode mode;
+        for (mode = 0; mode < NMODES; ++mode) {
+
+            if (!in_list(g_config.modes, g_mode_name[mode])) {
+                continue;
+            }
+
+            const char* threads = g_config.threads;
+
+            while (*threads) {
+                char* end;
+                unsigned long nthreads = strtoul(threads, &end, 0);
+                if ((end == threads) || !nthreads) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+
+                if (run_bench(g_set_type[i], mode, nthreads) < 0) {
+                    res = EXIT_FAILURE;
+                }
+
+                threads = *end == ',' ? end + 1 : end;
+            }
+        }
+    }
+
+    return res;
+}
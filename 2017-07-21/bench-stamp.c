@@ -0,0 +1,182 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * STAMP-style application benchmarks
+ *
+ *  Run
+ *
+ *      make bench
+ *      ./bench-stamp [-t THREADS] [-x SCALE] [-r SEED] [-u] [APP...]
+ *
+ *  to run ports of the STAMP applications genome, intruder, kmeans,
+ *  labyrinth, ssca2 and vacation. Unlike the micro benchmarks, they
+ *  run long transactions with large read and write sets. Each
+ *  application generates its input from SEED, so no downloads are
+ *  required, and verifies its result. THREADS is a comma-separated
+ *  list; the benchmark prints a line of CSV per application and
+ *  thread count.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stamp.h"
+#include "tm.h"
+
+static const struct stamp_app* const g_app[] = {
+    &g_stamp_genome,
+    &g_stamp_intruder,
+    &g_stamp_kmeans,
+    &g_stamp_labyrinth,
+    &g_stamp_ssca2,
+    &g_stamp_vacation
+};
+
+static const struct stamp_app* g_current_app;
+static void*                   g_state;
+
+static void
+run_app_thread(unsigned long index, void* arg)
+{
+    g_current_app->run(g_state, index);
+}
+
+/* Returns true if the application's result is correct. */
+static bool
+run_app(const struct stamp_app* app, const struct stamp_config* config, bool pin)
+{
+    g_current_app = app;
+    g_state = app->setup(config);
+
+    unsigned long commits;
+    unsigned long aborts = bench_total_aborts(&commits);
+
+    uint64_t begin_ns = bench_now_ns();
+
+    bench_run_threads(config->nthreads, pin, run_app_thread, NULL);
+
+    double seconds = (bench_now_ns() - begin_ns) / 1e9;
+
+    unsigned long end_commits;
+    aborts = bench_total_aborts(&end_commits) - aborts;
+    commits = end_commits - commits;
+
+    bool verified = app->verify(g_state);
+
+    printf("%s,%lu,%lu,%.3f,%lu,%lu,%.4f,%s\n", app->name,
+           config->nthreads, config->scale, seconds, commits, aborts,
+           commits + aborts ? (double)aborts / (commits + aborts) : 0,
+           verified ? "ok" : "FAILED");
+    fflush(stdout);
+
+    app->teardown(g_state);
+
+    return verified;
+}
+
+static bool
+is_selected(const char* name, char** filter, int nfilters)
+{
+    if (!nfilters) {
+        return true;
+    }
+
+    int i;
+    for (i = 0; i < nfilters; ++i) {
+        if (!strcmp(filter[i], name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-t THREADS] [-x SCALE] [-r SEED] [-u] [APP...]\n"
+            "Apps: genome intruder kmeans labyrinth ssca2 vacation\n",
+            prog);
+}
+
+int
+main(int argc, char* argv[])
+{
+    const char* threads = "1,2,4";
+    bool pin = true;
+
+    struct stamp_config config = {
+        .nthreads = 1,
+        .scale = 1,
+        .seed = 1
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:x:r:uh")) != -1) {
+        switch (opt) {
+            case 't':
+                threads = optarg;
+                break;
+            case 'x':
+                config.scale = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'u':
+                pin = false;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (!config.scale) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("app,threads,scale,seconds,commits,aborts,abort_ratio,verified\n");
+
+    int res = EXIT_SUCCESS;
+
+    unsigned long i;
+    for (i = 0; i < sizeof(g_app) / sizeof(g_app[0]); ++i) {
+
+        if (!is_selected(g_app[i]->name, argv + optind, argc - optind)) {
+            continue;
+        }
+
+        const char* beg = threads;
+
+        while (*beg) {
+            char* end;
+            config.nthreads = strtoul(beg, &end, 0);
+            if ((end == beg) || !config.nthreads) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+
+            if (!run_app(g_app[i], &config, pin)) {
+                res = EXIT_FAILURE;
+            }
+
+            beg = *end == ',' ? end + 1 : end;
+        }
+    }
+
+    return res;
+}
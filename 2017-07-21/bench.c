@@ -0,0 +1,272 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#define _GNU_SOURCE /* for pthread_setaffinity_np() */
+
+#include "bench.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "thread.h"
+#include "tm.h"
+
+unsigned long
+bench_ncpus()
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return ncpus > 0 ? ncpus : 1;
+}
+
+int
+bench_pin_thread(unsigned long cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % bench_ncpus(), &set);
+
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+uint64_t
+bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+void
+bench_spin_ns(uint64_t ns)
+{
+    if (!ns) {
+        return;
+    }
+
+    uint64_t end = bench_now_ns() + ns;
+
+    while (bench_now_ns() < end) {
+        cpu_relax();
+    }
+}
+
+void
+bench_wait_until_ns(uint64_t ns)
+{
+    /* Wake-ups from sleep are late by tens of microseconds. */
+    static const uint64_t slack_ns = 100000;
+
+    uint64_t now = bench_now_ns();
+
+    if (ns > now + slack_ns) {
+        uint64_t wake = ns - slack_ns;
+        struct timespec ts = {
+            .tv_sec = wake / 1000000000ul,
+            .tv_nsec = wake % 1000000000ul
+        };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+            continue;
+        }
+        now = bench_now_ns();
+    }
+
+    if (ns > now) {
+        bench_spin_ns(ns - now);
+    }
+}
+
+void*
+bench_calloc(size_t nmemb, size_t size)
+{
+    void* mem = calloc(nmemb, size);
+    if (!mem) {
+        perror("calloc");
+        abort(); /* We cannot allocate; let's abort for now. */
+    }
+
+    return mem;
+}
+
+void*
+bench_calloc_aligned(size_t nmemb, size_t size, size_t align)
+{
+    void* mem;
+
+    int err = posix_memalign(&mem, align, nmemb * size);
+    if (err) {
+        errno = err;
+        perror("posix_memalign");
+        abort(); /* We cannot allocate; let's abort for now. */
+    }
+    memset(mem, 0, nmemb * size);
+
+    return mem;
+}
+
+void
+bench_rand_init(struct bench_rand* rand, uint64_t seed)
+{
+    /* The state must not be 0; splitmix64 spreads small seeds. */
+    uint64_t z = seed + 0x9e3779b97f4a7c15ul;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+    z ^= z >> 31;
+
+    rand->state = z ? z : 1;
+}
+
+static int
+compare_doubles(const void* lhs, const void* rhs)
+{
+    double l = *(const double*)lhs;
+    double r = *(const double*)rhs;
+
+    return (l > r) - (l < r);
+}
+
+static unsigned long
+isqrt(unsigned long n)
+{
+    unsigned long r = 0;
+
+    while ((r + 1) * (r + 1) <= n) {
+        ++r;
+    }
+
+    return r;
+}
+
+void
+bench_summarize(double* sample, unsigned long n, struct bench_summary* summary)
+{
+    summary->n = n;
+
+    if (!n) {
+        summary->median = summary->lo = summary->hi = 0;
+        return;
+    }
+
+    qsort(sample, n, sizeof(*sample), compare_doubles);
+
+    summary->median = n & 1 ? sample[n / 2]
+                            : (sample[n / 2 - 1] + sample[n / 2]) / 2;
+
+    /* The ranks of the interval are n/2 -+ 1.96 * sqrt(n)/2, which
+     * is about n/2 -+ sqrt(n). */
+    unsigned long width = isqrt(n) + 1;
+
+    summary->lo = sample[n / 2 > width ? n / 2 - width : 0];
+    summary->hi = sample[n / 2 + width < n ? n / 2 + width : n - 1];
+}
+
+unsigned long
+bench_total_aborts(unsigned long* commits)
+{
+    struct tm_stats stats;
+    tm_stats_snapshot(&stats);
+
+    if (commits) {
+        *commits = stats.commits;
+    }
+
+    unsigned long aborts = 0;
+    unsigned long reason;
+    for (reason = 0; reason < TM_NABORT_REASONS; ++reason) {
+        aborts += stats.aborts[reason];
+    }
+
+    return aborts;
+}
+
+bool
+bench_barrier_wait(pthread_barrier_t* barrier)
+{
+    int res = pthread_barrier_wait(barrier);
+    if (res && (res != PTHREAD_BARRIER_SERIAL_THREAD)) {
+        errno = res;
+        perror("pthread_barrier_wait");
+        abort();
+    }
+
+    return res == PTHREAD_BARRIER_SERIAL_THREAD;
+}
+
+struct bench_thread {
+    pthread_t     thread;
+    unsigned long index;
+    bool          pin;
+    void        (*func)(unsigned long, void*);
+    void*         arg;
+};
+
+static void*
+bench_thread_cb(void* arg)
+{
+    struct bench_thread* thread = arg;
+
+    if (thread->pin && (bench_pin_thread(thread->index) < 0)) {
+        perror("pthread_setaffinity_np");
+    }
+
+    thread->func(thread->index, thread->arg);
+
+    return NULL;
+}
+
+void
+bench_run_threads(unsigned long nthreads, bool pin,
+                  void (*func)(unsigned long, void*), void* arg)
+{
+    struct bench_thread* thread = calloc(nthreads, sizeof(*thread));
+    if (!thread) {
+        perror("calloc");
+        abort(); /* We cannot run threads; let's abort for now. */
+    }
+
+    unsigned long i;
+
+    for (i = 0; i < nthreads; ++i) {
+        thread[i].index = i;
+        thread[i].pin = pin;
+        thread[i].func = func;
+        thread[i].arg = arg;
+
+        int err = pthread_create(&thread[i].thread, NULL, bench_thread_cb,
+                                 thread + i);
+        if (err) {
+            errno = err;
+            perror("pthread_create");
+            abort();
+        }
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+        int err = pthread_join(thread[i].thread, NULL);
+        if (err) {
+            errno = err;
+            perror("pthread_join");
+            abort();
+        }
+    }
+
+    free(thread);
+}
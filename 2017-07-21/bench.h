@@ -0,0 +1,141 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Benchmark helpers
+ */
+
+/**
+ * Returns the number of online CPUs.
+ */
+unsigned long
+bench_ncpus(void);
+
+/**
+ * Pins the calling thread to a CPU, modulo the number of online
+ * CPUs. Returns 0 on success, or -1 with errno set on errors.
+ */
+int
+bench_pin_thread(unsigned long cpu);
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+uint64_t
+bench_now_ns(void);
+
+/**
+ * Spins for about ns nanoseconds; for think time between
+ * operations.
+ */
+void
+bench_spin_ns(uint64_t ns);
+
+/**
+ * Waits until bench_now_ns() reaches ns. Sleeps through most of long
+ * waits and spins for the rest, so other threads can run meanwhile.
+ * Returns immediately if ns has passed.
+ */
+void
+bench_wait_until_ns(uint64_t ns);
+
+/**
+ * Allocates zeroed memory for nmemb elements of size bytes. Release
+ * the memory with free(). Aborts on errors.
+ */
+void*
+bench_calloc(size_t nmemb, size_t size);
+
+/**
+ * Allocates zeroed memory for nmemb elements of size bytes, aligned
+ * to align bytes; for arrays of cache-line-aligned per-thread data.
+ * Release the memory with free(). Aborts on errors.
+ */
+void*
+bench_calloc_aligned(size_t nmemb, size_t size, size_t align);
+
+/**
+ * A fast per-thread random-number generator (xorshift64*)
+ */
+struct bench_rand {
+    uint64_t state;
+};
+
+void
+bench_rand_init(struct bench_rand* rand, uint64_t seed);
+
+static inline uint64_t
+bench_rand_next(struct bench_rand* rand)
+{
+    uint64_t x = rand->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rand->state = x;
+    return x * 0x2545f4914f6cdd1dul;
+}
+
+/**
+ * Returns a random number in [0, n).
+ */
+static inline uint64_t
+bench_rand_below(struct bench_rand* rand, uint64_t n)
+{
+    return (uint64_t)(((unsigned __int128)bench_rand_next(rand) * n) >> 64);
+}
+
+/**
+ * Median of a sample with its 95% confidence interval
+ */
+struct bench_summary {
+    unsigned long n;
+    double        median;
+    double        lo;
+    double        hi;
+};
+
+/**
+ * Sorts the sample and computes its median. The confidence interval
+ * comes from the order statistics around the median, so it doesn't
+ * assume a distribution.
+ */
+void
+bench_summarize(double* sample, unsigned long n, struct bench_summary* summary);
+
+/**
+ * Returns the number of aborted transactions of all threads so far,
+ * and stores the number of commits in commits unless it's NULL.
+ */
+unsigned long
+bench_total_aborts(unsigned long* commits);
+
+/**
+ * Waits at a barrier and aborts on errors. Returns true in one of
+ * the waiting threads.
+ */
+bool
+bench_barrier_wait(pthread_barrier_t* barrier);
+
+/**
+ * Runs func(i, arg) in nthreads threads, with i from 0 to
+ * nthreads - 1, and waits for all of them. If pin is set, thread i
+ * runs on CPU i. Aborts on errors.
+ */
+void
+bench_run_threads(unsigned long nthreads, bool pin,
+                  void (*func)(unsigned long, void*), void* arg);
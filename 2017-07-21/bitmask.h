@@ -0,0 +1,134 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bit masks of arbitrary width, stored in an array of 64-bit words
+ */
+
+#define BITMASK_NWORDS(_nbits)  \
+    ( ((_nbits) + 63) / 64 )
+
+static inline bool
+bitmask_test(const uint64_t* mask, unsigned long bit)
+{
+    return !!(mask[bit / 64] & (1ul << (bit % 64)));
+}
+
+static inline void
+bitmask_set(uint64_t* mask, unsigned long bit)
+{
+    mask[bit / 64] |= 1ul << (bit % 64);
+}
+
+static inline bool
+bitmask_is_empty(const uint64_t* mask, unsigned long nwords)
+{
+    while (nwords) {
+        --nwords;
+        if (mask[nwords]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline unsigned long
+bitmask_count(const uint64_t* mask, unsigned long nwords)
+{
+    unsigned long count = 0;
+
+    while (nwords) {
+        --nwords;
+        count += __builtin_popcountl(mask[nwords]);
+    }
+    return count;
+}
+
+static inline void
+bitmask_clear(uint64_t* mask, unsigned long nwords)
+{
+    while (nwords) {
+        --nwords;
+        mask[nwords] = 0;
+    }
+}
+
+static inline void
+bitmask_not(uint64_t* dst, const uint64_t* src, unsigned long nwords)
+{
+    while (nwords) {
+        --nwords;
+        dst[nwords] = ~src[nwords];
+    }
+}
+
+/**
+ * Clears all bits in dst that are set in src.
+ */
+static inline void
+bitmask_andnot(uint64_t* dst, const uint64_t* src, unsigned long nwords)
+{
+    while (nwords) {
+        --nwords;
+        dst[nwords] &= ~src[nwords];
+    }
+}
+
+/**
+ * Returns a 64-bit mask with the lower n bits set.
+ */
+static inline uint64_t
+bitmask_low64(size_t n)
+{
+    return n < 64 ? (1ul << n) - 1 : ~0ul;
+}
+
+/**
+ * Returns n bits, at most 64, of mask starting at bit. The mask has
+ * nwords words.
+ */
+static inline uint64_t
+bitmask_extract(const uint64_t* mask, size_t nwords, unsigned long bit, size_t n)
+{
+    unsigned long word = bit / 64;
+    unsigned long shift = bit % 64;
+
+    uint64_t bits = mask[word] >> shift;
+
+    if (shift && (shift + n > 64) && (word + 1 < nwords)) {
+        bits |= mask[word + 1] << (64 - shift);
+    }
+
+    return bits & bitmask_low64(n);
+}
+
+/**
+ * Sets n bits of mask starting at bit.
+ */
+static inline void
+bitmask_set_range(uint64_t* mask, unsigned long bit, size_t n)
+{
+    while (n) {
+        unsigned long shift = bit % 64;
+        size_t len = 64 - shift < n ? 64 - shift : n;
+
+        mask[bit / 64] |= bitmask_low64(len) << shift;
+
+        bit += len;
+        n -= len;
+    }
+}
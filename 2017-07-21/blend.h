@@ -0,0 +1,229 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "bitmask.h"
+
+#if defined(__AVX512BW__) || defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Masked byte copies
+ *
+ * The helpers below copy whole words or vectors where they can. Bit i
+ * of a mask selects byte i of a buffer.
+ */
+
+static inline size_t
+min_size(size_t lhs, size_t rhs)
+{
+    return lhs < rhs ? lhs : rhs;
+}
+
+/**
+ * Copies n bytes; common sizes compile to a single move.
+ */
+static inline void
+copy_bytes(void* dst, const void* src, size_t n)
+{
+    switch (n) {
+        case 1:
+            memcpy(dst, src, 1);
+            break;
+        case 2:
+            memcpy(dst, src, 2);
+            break;
+        case 4:
+            memcpy(dst, src, 4);
+            break;
+        case 8:
+            memcpy(dst, src, 8);
+            break;
+        default:
+            memcpy(dst, src, n);
+            break;
+    }
+}
+
+/**
+ * Expands 8 bits to a mask of 8 bytes, each either 0x00 or 0xff.
+ */
+static inline uint64_t
+expand_bits8(uint8_t bits)
+{
+    uint64_t x = (bits * 0x0101010101010101ul) & 0x8040201008040201ul;
+
+    return (((x + 0x7f7f7f7f7f7f7f7ful) & 0x8080808080808080ul) >> 7) * 0xff;
+}
+
+/**
+ * Copies the selected bytes of at most 64 bytes from src to dst. The
+ * other bytes of dst may be rewritten with their current values, so
+ * only use this function on memory that no other thread writes.
+ */
+static inline void
+blend64(uint8_t* dst, const uint8_t* src, uint64_t bits, size_t n)
+{
+    if (!bits) {
+        return;
+    } else if (bits == bitmask_low64(n)) {
+        copy_bytes(dst, src, n);
+        return;
+    }
+
+#if defined(__AVX2__)
+    for (; n >= 32; n -= 32, dst += 32, src += 32, bits >>= 32) {
+        __m256i mask = _mm256_set_epi64x(expand_bits8(bits >> 24),
+                                         expand_bits8(bits >> 16),
+                                         expand_bits8(bits >> 8),
+                                         expand_bits8(bits));
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(d, s, mask));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; n >= 16; n -= 16, dst += 16, src += 16, bits >>= 16) {
+        __m128i mask = _mm_set_epi64x(expand_bits8(bits >> 8),
+                                      expand_bits8(bits));
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        _mm_storeu_si128((__m128i*)dst, _mm_blendv_epi8(d, s, mask));
+    }
+#endif
+    for (; n >= 8; n -= 8, dst += 8, src += 8, bits >>= 8) {
+        uint64_t mask = expand_bits8(bits);
+        uint64_t d, s;
+        memcpy(&d, dst, 8);
+        memcpy(&s, src, 8);
+        d = (d & ~mask) | (s & mask);
+        memcpy(dst, &d, 8);
+    }
+    for (; n; --n, ++dst, ++src, bits >>= 1) {
+        if (bits & 1) {
+            *dst = *src;
+        }
+    }
+}
+
+/**
+ * Copies the selected bytes of at most 64 bytes from src to dst,
+ * without touching any other byte of dst.
+ */
+static inline void
+store_masked64(uint8_t* dst, const uint8_t* src, uint64_t bits, size_t n)
+{
+    if (!bits) {
+        return;
+    } else if (bits == bitmask_low64(n)) {
+        copy_bytes(dst, src, n);
+        return;
+    }
+
+#if defined(__AVX512BW__)
+    _mm512_mask_storeu_epi8(dst, bits, _mm512_maskz_loadu_epi8(bits, src));
+#else
+    /* Copy each run of consecutive selected bytes. */
+    while (bits) {
+        unsigned long beg = __builtin_ctzl(bits);
+        uint64_t rest = ~(bits >> beg);
+        unsigned long len = rest ? __builtin_ctzl(rest) : 64 - beg;
+
+        copy_bytes(dst + beg, src + beg, len);
+
+        bits &= ~(bitmask_low64(len) << beg);
+    }
+#endif
+}
+
+/**
+ * Returns true if the selected bytes of at most 64 bytes are equal.
+ */
+static inline bool
+equal_masked64(const uint8_t* lhs, const uint8_t* rhs, uint64_t bits, size_t n)
+{
+    if (!bits) {
+        return true;
+    } else if (bits == bitmask_low64(n)) {
+        return !memcmp(lhs, rhs, n);
+    }
+
+    for (; n >= 8; n -= 8, lhs += 8, rhs += 8, bits >>= 8) {
+        uint64_t l, r;
+        memcpy(&l, lhs, 8);
+        memcpy(&r, rhs, 8);
+        if ((l ^ r) & expand_bits8(bits)) {
+            return false;
+        }
+    }
+    for (; n; --n, ++lhs, ++rhs, bits >>= 1) {
+        if ((bits & 1) && (*lhs != *rhs)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Variants for masks of nwords words; bit first of the mask selects
+ * byte 0 of the buffers.
+ */
+
+static inline void
+blend_bytes(void* dst, const void* src,
+            const uint64_t* mask, size_t nwords, unsigned long first, size_t n)
+{
+    unsigned long off;
+
+    for (off = 0; off < n; off += 64) {
+        size_t len = n - off < 64 ? n - off : 64;
+        blend64((uint8_t*)dst + off, (const uint8_t*)src + off,
+                bitmask_extract(mask, nwords, first + off, len), len);
+    }
+}
+
+static inline void
+store_masked(void* dst, const void* src,
+             const uint64_t* mask, size_t nwords, unsigned long first, size_t n)
+{
+    unsigned long off;
+
+    for (off = 0; off < n; off += 64) {
+        size_t len = n - off < 64 ? n - off : 64;
+        store_masked64((uint8_t*)dst + off, (const uint8_t*)src + off,
+                       bitmask_extract(mask, nwords, first + off, len), len);
+    }
+}
+
+static inline bool
+equal_masked(const void* lhs, const void* rhs,
+             const uint64_t* mask, size_t nwords, unsigned long first, size_t n)
+{
+    unsigned long off;
+
+    for (off = 0; off < n; off += 64) {
+        size_t len = n - off < 64 ? n - off : 64;
+        if (!equal_masked64((const uint8_t*)lhs + off,
+                            (const uint8_t*)rhs + off,
+                            bitmask_extract(mask, nwords, first + off, len), len)) {
+            return false;
+        }
+    }
+
+    return true;
+}
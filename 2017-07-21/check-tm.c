@@ -0,0 +1,202 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Regression checks of the transaction runtime
+ *
+ *  Run
+ *
+ *      make check
+ *
+ *  to run all checks. Each failed check prints a message; the
+ *  program exits with an error if any check failed. The checks link
+ *  with a tm.c built for a log of TM_LOG_MAX_NENTRIES entries.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+#include "tm.h"
+
+static unsigned long g_nfailed;
+
+static void
+check(bool cond, const char* what)
+{
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        ++g_nfailed;
+    }
+}
+
+/* Returns the site of the transactions in func, or NULL. */
+static const struct tm_site*
+find_site(const char* func)
+{
+    const struct tm_site* site[16];
+    unsigned long nsites = tm_sites(site, sizeof(site) / sizeof(site[0]));
+
+    unsigned long i;
+    for (i = 0; i < nsites; ++i) {
+        if (!strcmp(site[i]->func, func)) {
+            return site[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* A recovered transaction rolls back once, although its handler
+ * restarts it with tm_restart(). */
+static void
+check_recover(void)
+{
+    struct tm_stats before;
+    tm_stats_snapshot(&before);
+
+    tm_save bool recovered = false;
+
+    tm_begin
+        if (!recovered) {
+            tm_recover(ENOMEM);
+        }
+    tm_commit
+        check(tm_recovery_errno() == ENOMEM, "recovery errno");
+        recovered = true;
+        tm_restart();
+    tm_end
+
+    struct tm_stats after;
+    tm_stats_snapshot(&after);
+
+    check(after.commits - before.commits == 1, "one commit");
+    check(after.aborts[TM_ABORT_ERRNO] - before.aborts[TM_ABORT_ERRNO] == 1,
+          "one ERRNO abort");
+    check(after.aborts[TM_ABORT_RESTART] == before.aborts[TM_ABORT_RESTART],
+          "no RESTART abort");
+    check(after.max_retries == 1, "one retry");
+
+    const struct tm_site* site = find_site(__func__);
+    check(site != NULL, "site");
+    if (!site) {
+        return;
+    }
+
+    struct tm_stats site_stats;
+    tm_site_stats_snapshot(site, &site_stats);
+
+    check(site_stats.commits == 1, "one commit at site");
+    check(site_stats.aborts[TM_ABORT_ERRNO] == 1, "one ERRNO abort at site");
+    check(!site_stats.aborts[TM_ABORT_RESTART], "no RESTART abort at site");
+}
+
+static unsigned long g_napplied;
+static unsigned long g_nundone;
+
+static void
+count_apply(uintptr_t data)
+{
+    ++g_napplied;
+}
+
+static void
+count_undo(uintptr_t data)
+{
+    ++g_nundone;
+}
+
+/* A transaction that exceeds TM_LOG_MAX_NENTRIES log entries
+ * undoes all of them and recovers with ENOMEM. */
+static void
+check_log_overflow(void)
+{
+    struct tm_stats before;
+    tm_stats_snapshot(&before);
+
+    tm_save unsigned long nlogged = 0;
+    tm_save bool recovered = false;
+
+    tm_begin
+        while (nlogged <= 2 * TM_LOG_MAX_NENTRIES) {
+            append_to_log(count_apply, count_undo, 0);
+            ++nlogged;
+        }
+    tm_commit
+        check(tm_recovery_errno() == ENOMEM, "log overflow errno");
+        recovered = true;
+    tm_end
+
+    struct tm_stats after;
+    tm_stats_snapshot(&after);
+
+    check(recovered, "log overflow recovers");
+    check(nlogged <= TM_LOG_MAX_NENTRIES, "log within TM_LOG_MAX_NENTRIES");
+    check(!g_napplied, "no entry applied");
+    /* The entry that didn't fit is undone, too. */
+    check(g_nundone == nlogged + 1, "all entries undone");
+    check(after.aborts[TM_ABORT_LOG_OVERFLOW] -
+          before.aborts[TM_ABORT_LOG_OVERFLOW] == 1, "one LOG_OVERFLOW abort");
+    check(after.commits == before.commits, "no commit");
+}
+
+static unsigned long g_nfreed;
+
+static void
+count_free(void* ptr)
+{
+    ++g_nfreed;
+}
+
+/* Retires the blocks in an epoch of their own. */
+static void
+retire_blocks(char* block, unsigned long nblocks)
+{
+    epoch_enter();
+
+    unsigned long i;
+    for (i = 0; i < nblocks; ++i) {
+        epoch_retire(block + i, count_free);
+    }
+
+    epoch_leave();
+}
+
+/* Retired blocks are freed two epochs later. Each call to
+ * retire_blocks() sweeps and advances the epoch once. */
+static void
+check_epoch(void)
+{
+    static char block[2 * EPOCH_SWEEP_NRETIRED + 1];
+
+    retire_blocks(block, EPOCH_SWEEP_NRETIRED + 1);
+    check(!g_nfreed, "nothing freed after one epoch");
+
+    retire_blocks(block + EPOCH_SWEEP_NRETIRED + 1, EPOCH_SWEEP_NRETIRED);
+    check(g_nfreed == EPOCH_SWEEP_NRETIRED + 1, "freed after two epochs");
+}
+
+int
+main(int argc, char* argv[])
+{
+    check_recover();
+    check_log_overflow();
+    check_epoch();
+
+    if (g_nfailed) {
+        fprintf(stderr, "%lu checks failed\n", g_nfailed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,269 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "conflict.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONFLICT_NENTRIES_BITSHIFT  (12)
+#define CONFLICT_NENTRIES           (1ul << CONFLICT_NENTRIES_BITSHIFT)
+
+#if defined(TM_CONFLICT_PROFILING)
+
+/* Open-addressed tables of hotspots; key 0 marks a free entry. */
+static struct conflict_hotspot g_conflict_address[CONFLICT_NENTRIES];
+static struct conflict_hotspot g_conflict_slot[CONFLICT_NENTRIES];
+
+__thread const void* t_conflict_site;
+
+static unsigned long  g_conflict_sample = 16;
+static pthread_once_t g_conflict_once = PTHREAD_ONCE_INIT;
+
+/* Conflicts until the current thread's next sample */
+static __thread unsigned long t_conflict_countdown;
+
+static void
+init_sampling(void)
+{
+    const char* env = getenv("SIMPLETM_CONFLICT_SAMPLE");
+    if (env) {
+        g_conflict_sample = strtoul(env, NULL, 0);
+    }
+    if (!g_conflict_sample) {
+        g_conflict_sample = 1;
+    }
+}
+
+static bool
+take_sample(void)
+{
+    if (t_conflict_countdown) {
+        --t_conflict_countdown;
+        return false;
+    }
+
+    int err = pthread_once(&g_conflict_once, init_sampling);
+    if (err) {
+        errno = err;
+        perror("pthread_once");
+        abort();
+    }
+
+    t_conflict_countdown = g_conflict_sample - 1;
+
+    return true;
+}
+
+/* Returns the entry for key, or NULL if the table is full. */
+static struct conflict_hotspot*
+find_hotspot(struct conflict_hotspot* table, uintptr_t key)
+{
+    uint64_t hash = key * 0x9e3779b97f4a7c15ul;
+    unsigned long i = hash >> (64 - CONFLICT_NENTRIES_BITSHIFT);
+    unsigned long n;
+
+    for (n = 0; n < CONFLICT_NENTRIES; ++n) {
+
+        struct conflict_hotspot* hotspot = table + i;
+
+        uintptr_t expected = __atomic_load_n(&hotspot->key, __ATOMIC_RELAXED);
+
+        if (expected == key) {
+            return hotspot;
+        } else if (!expected &&
+                   (__atomic_compare_exchange_n(&hotspot->key, &expected, key,
+                                                false, __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED) ||
+                    (expected == key))) {
+            return hotspot;
+        }
+
+        i = (i + 1) & (CONFLICT_NENTRIES - 1);
+    }
+
+    return NULL; /* Table full; drop the sample. */
+}
+
+static void
+count_slot(unsigned long slot)
+{
+    if (slot == CONFLICT_NO_SLOT) {
+        return;
+    }
+
+    /* Keys are slots plus one, so slot 0 is not a free entry. */
+    struct conflict_hotspot* hotspot = find_hotspot(g_conflict_slot, slot + 1);
+    if (hotspot) {
+        __atomic_add_fetch(&hotspot->count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void
+conflict_record(uintptr_t base, unsigned long slot, unsigned long owner)
+{
+    if (!take_sample()) {
+        return;
+    }
+
+    count_slot(slot);
+
+    if (!base) {
+        return;
+    }
+
+    struct conflict_hotspot* hotspot = find_hotspot(g_conflict_address, base);
+    if (!hotspot) {
+        return;
+    }
+
+    __atomic_add_fetch(&hotspot->count, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hotspot->slot, slot, __ATOMIC_RELAXED);
+    __atomic_store_n(&hotspot->owner, owner, __ATOMIC_RELAXED);
+    __atomic_store_n(&hotspot->site, t_conflict_site, __ATOMIC_RELAXED);
+}
+
+void
+conflict_record_alias(unsigned long slot)
+{
+    if (take_sample()) {
+        count_slot(slot);
+    }
+}
+
+#endif
+
+/*
+ * Reports
+ */
+
+#if defined(TM_CONFLICT_PROFILING)
+
+static int
+compare_hotspots(const void* lhs, const void* rhs)
+{
+    unsigned long lcount = ((const struct conflict_hotspot*)lhs)->count;
+    unsigned long rcount = ((const struct conflict_hotspot*)rhs)->count;
+
+    return (lcount < rcount) - (lcount > rcount);
+}
+
+static unsigned long
+top_hotspots(const struct conflict_hotspot* table,
+             struct conflict_hotspot* top, unsigned long n)
+{
+    struct conflict_hotspot* sorted = malloc(sizeof(g_conflict_address));
+    if (!sorted) {
+        perror("malloc");
+        abort(); /* We cannot sort; let's abort for now. */
+    }
+
+    unsigned long nsorted = 0;
+    unsigned long i;
+
+    for (i = 0; i < CONFLICT_NENTRIES; ++i) {
+        struct conflict_hotspot* hotspot = sorted + nsorted;
+        hotspot->key   = __atomic_load_n(&table[i].key, __ATOMIC_RELAXED);
+        hotspot->count = __atomic_load_n(&table[i].count, __ATOMIC_RELAXED);
+        hotspot->slot  = __atomic_load_n(&table[i].slot, __ATOMIC_RELAXED);
+        hotspot->owner = __atomic_load_n(&table[i].owner, __ATOMIC_RELAXED);
+        hotspot->site  = __atomic_load_n(&table[i].site, __ATOMIC_RELAXED);
+        if (hotspot->key && hotspot->count) {
+            ++nsorted;
+        }
+    }
+
+    qsort(sorted, nsorted, sizeof(*sorted), compare_hotspots);
+
+    n = n < nsorted ? n : nsorted;
+    memcpy(top, sorted, n * sizeof(*top));
+
+    free(sorted);
+
+    return n;
+}
+
+unsigned long
+conflict_top_addresses(struct conflict_hotspot* top, unsigned long n)
+{
+    return top_hotspots(g_conflict_address, top, n);
+}
+
+unsigned long
+conflict_top_slots(struct conflict_hotspot* top, unsigned long n)
+{
+    n = top_hotspots(g_conflict_slot, top, n);
+
+    unsigned long i;
+    for (i = 0; i < n; ++i) {
+        --top[i].key;
+    }
+
+    return n;
+}
+
+#else
+
+/* Without profiling, there are no samples to report. */
+
+unsigned long
+conflict_top_addresses(struct conflict_hotspot* top, unsigned long n)
+{
+    return 0;
+}
+
+unsigned long
+conflict_top_slots(struct conflict_hotspot* top, unsigned long n)
+{
+    return 0;
+}
+
+#endif
+
+void
+conflict_report(FILE* file, unsigned long n)
+{
+    struct conflict_hotspot* top = calloc(n, sizeof(*top));
+    if (!top) {
+        perror("calloc");
+        abort(); /* We cannot report; let's abort for now. */
+    }
+
+    unsigned long ntop = conflict_top_addresses(top, n);
+
+    fprintf(file, "Contended addresses (sampled)\n");
+    fprintf(file, "%12s  %18s  %10s  %6s  %18s\n",
+            "count", "address", "slot", "owner", "site");
+
+    unsigned long i;
+    for (i = 0; i < ntop; ++i) {
+        fprintf(file, "%12lu  %#18lx  ", top[i].count, (unsigned long)top[i].key);
+        if (top[i].slot == CONFLICT_NO_SLOT) {
+            fprintf(file, "%10s  ", "-");
+        } else {
+            fprintf(file, "%10lu  ", top[i].slot);
+        }
+        fprintf(file, "%6lu  %18p\n", top[i].owner, top[i].site);
+    }
+
+    ntop = conflict_top_slots(top, n);
+
+    fprintf(file, "Contended or aliased slots (sampled)\n");
+    fprintf(file, "%12s  %10s\n", "count", "slot");
+
+    for (i = 0; i < ntop; ++i) {
+        fprintf(file, "%12lu  %10lu\n", top[i].count, (unsigned long)top[i].key);
+    }
+
+    free(top);
+}
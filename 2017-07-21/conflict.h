@@ -0,0 +1,107 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Conflict profiler
+ *
+ * Build with 'make TM_CONFLICT_PROFILING=1' to find contended data.
+ * Engines then sample one in SIMPLETM_CONFLICT_SAMPLE conflicts
+ * (default: 16) and count them per base address and per slot, i.e.,
+ * resource set (own) or lock (tl2). The ownership engine also counts
+ * aliased claims per resource set. Each address remembers the slot,
+ * owner thread and call site of its latest sample. Call sites are
+ * code addresses; resolve them with addr2line.
+ *
+ * Without TM_CONFLICT_PROFILING, all functions are empty and inline.
+ */
+
+/* Slot of engines without per-location metadata */
+#define CONFLICT_NO_SLOT    (~0ul)
+
+/**
+ * A contended address or slot
+ */
+struct conflict_hotspot {
+    uintptr_t     key;
+    unsigned long count;
+    /* Latest sample; addresses only */
+    unsigned long slot;
+    unsigned long owner;
+    const void*   site;
+};
+
+#if defined(TM_CONFLICT_PROFILING)
+
+/* Code address of the current access. Don't use directly; call
+ * conflict_set_site() instead. */
+extern __thread const void* t_conflict_site;
+
+static inline void
+conflict_set_site(const void* site)
+{
+    t_conflict_site = site;
+}
+
+/**
+ * Samples a conflict on base, which is 0 if unknown, with the given
+ * slot and owner thread, which is 0 if unknown.
+ */
+void
+conflict_record(uintptr_t base, unsigned long slot, unsigned long owner);
+
+/**
+ * Samples a claim of a resource in a set held by other addresses.
+ */
+void
+conflict_record_alias(unsigned long slot);
+
+#else
+
+#define conflict_set_site(_site)    ((void)0)
+
+static inline void
+conflict_record(uintptr_t base, unsigned long slot, unsigned long owner)
+{ }
+
+static inline void
+conflict_record_alias(unsigned long slot)
+{ }
+
+#endif
+
+/* Address of the current code location */
+#define conflict_here()                     \
+    ({ __label__ _here; _here: &&_here; })
+
+/**
+ * Stores the n most contended addresses in top, most contended
+ * first, and returns their number.
+ */
+unsigned long
+conflict_top_addresses(struct conflict_hotspot* top, unsigned long n);
+
+/**
+ * Stores the n most contended slots in top, most contended first,
+ * and returns their number.
+ */
+unsigned long
+conflict_top_slots(struct conflict_hotspot* top, unsigned long n);
+
+/**
+ * Prints the n most contended addresses and slots.
+ */
+void
+conflict_report(FILE* file, unsigned long n);
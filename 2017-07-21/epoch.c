@@ -0,0 +1,134 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "epoch.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "array.h"
+#include "thread.h"
+
+/**
+ * Memory waiting to be freed
+ */
+struct epoch_retired {
+    void*    ptr;
+    void     (*free_func)(void*);
+    uint64_t epoch;
+};
+
+static uint64_t g_epoch = 1;
+
+/**
+ * Per-thread state
+ */
+struct epoch_thread {
+    /* The announced epoch, or 0 outside of transactions */
+    uint64_t              epoch;
+    /* Limbo list, ordered by epoch */
+    struct epoch_retired* limbo;
+    unsigned long         nlimbo;
+    unsigned long         limbocap;
+    /* Retirements since the last sweep */
+    unsigned long         nretired;
+} __attribute__((aligned(64)));
+
+static struct epoch_thread g_epoch_thread[NTHREADS];
+
+/* Advances the global epoch if all running transactions announced
+ * the current one. Returns the global epoch. */
+static uint64_t
+try_advance_epoch(void)
+{
+    uint64_t epoch = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST);
+
+    unsigned long i;
+    for (i = 0; i < arraylen(g_epoch_thread); ++i) {
+        uint64_t announced = __atomic_load_n(&g_epoch_thread[i].epoch,
+                                             __ATOMIC_SEQ_CST);
+        if (announced && (announced != epoch)) {
+            return epoch;
+        }
+    }
+
+    if (__atomic_compare_exchange_n(&g_epoch, &epoch, epoch + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return epoch + 1;
+    }
+
+    return epoch; /* Advanced by another thread */
+}
+
+static void
+sweep(struct epoch_thread* thread)
+{
+    uint64_t epoch = try_advance_epoch();
+
+    struct epoch_retired* beg = thread->limbo;
+    struct epoch_retired* end = beg + thread->nlimbo;
+    struct epoch_retired* pos = beg;
+
+    while ((pos < end) && (pos->epoch + 2 <= epoch)) {
+        pos->free_func(pos->ptr);
+        ++pos;
+    }
+
+    memmove(beg, pos, (end - pos) * sizeof(*beg));
+
+    thread->nlimbo = end - pos;
+    thread->nretired = 0;
+}
+
+void
+epoch_enter()
+{
+    struct epoch_thread* thread = g_epoch_thread + thread_id();
+    uint64_t epoch;
+
+    /* A concurrent advance either sees our announcement, or we
+     * see the new epoch. */
+    do {
+        epoch = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&thread->epoch, epoch, __ATOMIC_SEQ_CST);
+    } while (epoch != __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST));
+}
+
+void
+epoch_leave()
+{
+    struct epoch_thread* thread = g_epoch_thread + thread_id();
+
+    __atomic_store_n(&thread->epoch, 0, __ATOMIC_RELEASE);
+
+    if (thread->nretired >= EPOCH_SWEEP_NRETIRED) {
+        sweep(thread);
+    }
+}
+
+void
+epoch_retire(void* ptr, void (*free_func)(void*))
+{
+    struct epoch_thread* thread = g_epoch_thread + thread_id();
+
+    if (thread->nlimbo == thread->limbocap) {
+        thread->limbo = arraygrow(thread->limbo, &thread->limbocap,
+                                  sizeof(*thread->limbo));
+    }
+
+    struct epoch_retired* retired = thread->limbo + thread->nlimbo;
+
+    retired->ptr = ptr;
+    retired->free_func = free_func;
+    retired->epoch = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST);
+
+    ++thread->nlimbo;
+    ++thread->nretired;
+}
@@ -0,0 +1,48 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+/*
+ * Epoch-based reclamation
+ *
+ * Transactions announce the global epoch while they run. Memory
+ * retired in epoch e is freed once the global epoch reached e + 2;
+ * by then, no transaction that could have seen it is still running.
+ *
+ * Retired memory waits in a limbo list of the retiring thread's id.
+ * Every EPOCH_SWEEP_NRETIRED retirements, the thread tries to advance
+ * the global epoch and frees what has become safe. Lists of exited
+ * threads are swept by the next thread with the same id.
+ */
+
+#define EPOCH_SWEEP_NRETIRED    (128)
+
+/**
+ * Announces the current epoch for the calling thread. Call before
+ * a transaction accesses shared memory.
+ */
+void
+epoch_enter(void);
+
+/**
+ * Ends the calling thread's announcement and possibly sweeps its
+ * limbo list.
+ */
+void
+epoch_leave(void);
+
+/**
+ * Frees ptr with free_func once no running transaction can
+ * reference it anymore.
+ */
+void
+epoch_retire(void* ptr, void (*free_func)(void*));
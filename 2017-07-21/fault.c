@@ -0,0 +1,106 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "fault.h"
+
+#if defined(TM_FAULT_INJECTION)
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "thread.h"
+
+static const char* const g_fault_env[FAULT_NSITES] = {
+    [FAULT_ALLOC]   = "SIMPLETM_FAULT_ALLOC",
+    [FAULT_ACQUIRE] = "SIMPLETM_FAULT_ACQUIRE",
+    [FAULT_LOG]     = "SIMPLETM_FAULT_LOG"
+};
+
+static unsigned long g_fault_rate[FAULT_NSITES] = {
+    [FAULT_ALLOC] = 3
+};
+
+static uint64_t g_fault_seed = 1;
+
+static pthread_once_t g_fault_once = PTHREAD_ONCE_INIT;
+
+/* The current thread's generator, or 0 if not seeded yet */
+static __thread uint64_t t_fault_state;
+
+static void
+init_faults(void)
+{
+    const char* env = getenv("SIMPLETM_FAULT_SEED");
+    if (env) {
+        g_fault_seed = strtoull(env, NULL, 0);
+    }
+
+    unsigned long site;
+    for (site = 0; site < FAULT_NSITES; ++site) {
+        env = getenv(g_fault_env[site]);
+        if (env) {
+            g_fault_rate[site] = strtoul(env, NULL, 0);
+        }
+    }
+}
+
+static void
+init_faults_once(void)
+{
+    int err = pthread_once(&g_fault_once, init_faults);
+    if (err) {
+        errno = err;
+        perror("pthread_once");
+        abort();
+    }
+}
+
+/* xorshift64* */
+static uint64_t
+next_random(void)
+{
+    if (!t_fault_state) {
+        init_faults_once();
+        /* Mix seed and thread id; the state must not be 0. */
+        t_fault_state = (g_fault_seed + thread_id()) * 0x9e3779b97f4a7c15ul;
+        if (!t_fault_state) {
+            t_fault_state = 1;
+        }
+    }
+
+    t_fault_state ^= t_fault_state >> 12;
+    t_fault_state ^= t_fault_state << 25;
+    t_fault_state ^= t_fault_state >> 27;
+
+    return t_fault_state * 0x2545f4914f6cdd1dul;
+}
+
+bool
+fault_inject(enum fault_site site)
+{
+    uint64_t random = next_random();
+
+    unsigned long rate = __atomic_load_n(g_fault_rate + site, __ATOMIC_RELAXED);
+
+    return rate && !((random >> 32) % rate);
+}
+
+void
+fault_set_rate(enum fault_site site, unsigned long n)
+{
+    init_faults_once();
+
+    __atomic_store_n(g_fault_rate + site, n, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,68 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * Fault injection
+ *
+ * Build with 'make TM_FAULT_INJECTION=1' to test recovery paths.
+ * Each site then fails once in every n calls on average, driven by a
+ * per-thread pseudo-random generator. Runs with the same seed and
+ * thread interleaving fail at the same calls. Configure with the
+ * environment variables
+ *
+ *  SIMPLETM_FAULT_SEED:    seed of the generators (default: 1)
+ *  SIMPLETM_FAULT_ALLOC:   n for malloc_tx() failing with ENOMEM (default: 3)
+ *  SIMPLETM_FAULT_ACQUIRE: n for conflicts on acquiring ownership or
+ *                          locks (default: 0, never)
+ *  SIMPLETM_FAULT_LOG:     n for log overflows (default: 0, never)
+ *
+ * Without TM_FAULT_INJECTION, fault_inject() is constant false and
+ * compiles to nothing.
+ */
+
+enum fault_site {
+    FAULT_ALLOC,
+    FAULT_ACQUIRE,
+    FAULT_LOG,
+    FAULT_NSITES
+};
+
+#if defined(TM_FAULT_INJECTION)
+
+/**
+ * Returns true if the call at the site shall fail.
+ */
+bool
+fault_inject(enum fault_site site);
+
+/**
+ * Sets a site's failure rate to once in n calls; 0 disables the site.
+ */
+void
+fault_set_rate(enum fault_site site, unsigned long n);
+
+#else
+
+static inline bool
+fault_inject(enum fault_site site)
+{
+    return false;
+}
+
+static inline void
+fault_set_rate(enum fault_site site, unsigned long n)
+{ }
+
+#endif
@@ -0,0 +1,66 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "histogram.h"
+
+void
+histogram_merge(struct histogram* dst, const struct histogram* src)
+{
+    unsigned long i;
+    for (i = 0; i < HISTOGRAM_NBUCKETS; ++i) {
+        dst->count[i] += __atomic_load_n(src->count + i, __ATOMIC_RELAXED);
+    }
+
+    dst->total += __atomic_load_n(&src->total, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if (max > dst->max) {
+        dst->max = max;
+    }
+}
+
+uint64_t
+histogram_percentile(const struct histogram* hist, double fraction)
+{
+    /* The total might lag behind the buckets while the owner
+     * records; count the buckets instead. */
+    unsigned long total = 0;
+    unsigned long i;
+
+    for (i = 0; i < HISTOGRAM_NBUCKETS; ++i) {
+        total += hist->count[i];
+    }
+
+    if (!total) {
+        return 0;
+    }
+
+    unsigned long rank = (unsigned long)(fraction * total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+
+    unsigned long seen = 0;
+
+    for (i = 0; i < HISTOGRAM_NBUCKETS; ++i) {
+        seen += hist->count[i];
+        if (seen > rank) {
+            break;
+        }
+    }
+
+    /* Report the bucket's largest value, so that percentiles
+     * don't understate latencies. */
+    uint64_t value = i + 1 < HISTOGRAM_NBUCKETS ? histogram_bucket_value(i + 1) - 1
+                                                : UINT64_MAX;
+
+    return value < hist->max ? value : hist->max;
+}
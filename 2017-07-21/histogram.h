@@ -0,0 +1,91 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Log-linear histograms
+ *
+ * Values below 2^HISTOGRAM_SUB_BITSHIFT have their own buckets.
+ * Larger values fall into 2^HISTOGRAM_SUB_BITSHIFT linear buckets
+ * per power of two, so each bucket is within 1/16th of its values.
+ */
+
+#define HISTOGRAM_SUB_BITSHIFT  (4)
+#define HISTOGRAM_SUB_NBUCKETS  (1ul << HISTOGRAM_SUB_BITSHIFT)
+#define HISTOGRAM_NBUCKETS      ((64 - HISTOGRAM_SUB_BITSHIFT + 1) << HISTOGRAM_SUB_BITSHIFT)
+
+struct histogram {
+    unsigned long count[HISTOGRAM_NBUCKETS];
+    unsigned long total;
+    uint64_t      max;
+};
+
+static inline unsigned long
+histogram_bucket(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_NBUCKETS) {
+        return value;
+    }
+
+    unsigned long magnitude = 63 - __builtin_clzl(value);
+    unsigned long shift = magnitude - HISTOGRAM_SUB_BITSHIFT;
+
+    return ((shift + 1) << HISTOGRAM_SUB_BITSHIFT) +
+           ((value >> shift) & (HISTOGRAM_SUB_NBUCKETS - 1));
+}
+
+/**
+ * Returns the smallest value of a bucket.
+ */
+static inline uint64_t
+histogram_bucket_value(unsigned long bucket)
+{
+    if (bucket < HISTOGRAM_SUB_NBUCKETS) {
+        return bucket;
+    }
+
+    unsigned long shift = (bucket >> HISTOGRAM_SUB_BITSHIFT) - 1;
+
+    return (HISTOGRAM_SUB_NBUCKETS + (bucket & (HISTOGRAM_SUB_NBUCKETS - 1)))
+               << shift;
+}
+
+/**
+ * Adds a value. Only the histogram's owner thread may call this
+ * function; other threads read the histogram with histogram_merge().
+ */
+static inline void
+histogram_record(struct histogram* hist, uint64_t value)
+{
+    ++hist->count[histogram_bucket(value)];
+    ++hist->total;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+/**
+ * Adds the values of src to dst.
+ */
+void
+histogram_merge(struct histogram* dst, const struct histogram* src);
+
+/**
+ * Returns the value below which the given fraction of values lies,
+ * at the resolution of the buckets; e.g., 0.99 for the 99th
+ * percentile. The result is the largest value of its bucket, but
+ * at most the largest recorded value.
+ */
+uint64_t
+histogram_percentile(const struct histogram* hist, double fraction);
@@ -13,10 +13,21 @@
  *  On your Linux terminal, run
  *
  *      make all
- *      ./simpletm
+ *      ./simpletm [-p PRODUCERS] [-c CONSUMERS] [-x SCALES] [-d SECONDS]
+ *                 [-k THINK_NS] [-q SLOTS] [-u] [-r]
  *
  *  to build and execute this example. Building requires gcc and the
  *  usual C development tools for Unix.
+ *
+ *  Producers store buffers from malloc_tx() into empty slots of a
+ *  queue; consumers take them out again, verify them and release
+ *  them with free_tx(). For each factor in SCALES, the benchmark runs
+ *  factor * PRODUCERS producers and factor * CONSUMERS consumers for
+ *  SECONDS and prints a line of CSV: thread counts, commits per
+ *  second, abort ratio and fairness among threads. Threads are pinned
+ *  to CPUs, unless -u is given, and spin for THINK_NS nanoseconds
+ *  between transactions. With -r, the per-site statistics follow on
+ *  stderr.
  */
 
 #include <errno.h>
@@ -26,10 +37,51 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "bench.h"
 #include "stdlib-tx.h"
 #include "tm.h"
 
-static int* g_i __attribute__((aligned(128)));
+/* Transactions between checks of the deadline */
+#define DEADLINE_INTERVAL   (16)
+
+struct config {
+    unsigned long nproducers;
+    unsigned long nconsumers;
+    const char*   scales;
+    double        seconds;
+    uint64_t      think_ns;
+    unsigned long nslots;
+    bool          pin;
+    bool          report;
+};
+
+/* A queue slot on its own cache line */
+struct slot {
+    long* buf;
+} __attribute__((aligned(64)));
+
+/* Results of a thread */
+struct worker {
+    struct bench_rand rand;
+    unsigned long     commits;
+    unsigned long     nitems;
+    uint64_t          end_ns;
+} __attribute__((aligned(64)));
+
+static struct config      g_config;
+static struct slot*       g_slot;
+static struct worker*     g_worker;
+static unsigned long      g_nproducers;
+static pthread_barrier_t  g_barrier;
+static uint64_t           g_begin_ns;
+static uint64_t           g_deadline_ns;
+static unsigned long      g_nerrors;
+
+static long
+checksum(long value)
+{
+    return value * 0x9e3779b97f4a7c15l + 1;
+}
 
 static void
 recover_from_errno(int errno_code)
@@ -38,148 +90,339 @@ recover_from_errno(int errno_code)
             strerror(errno_code));
 }
 
-static void
-producer_func(void)
+/* Returns true if the producer filled a slot. */
+static bool
+produce(struct worker* worker)
 {
-    unsigned int seed = 1;
+    struct slot* slot = g_slot + bench_rand_below(&worker->rand, g_config.nslots);
 
-    tm_save int i[2] = {0, 0};
+    long value = bench_rand_next(&worker->rand);
 
-    while (true) {
+    tm_save bool produced = false;
 
-        sleep(1);
+    tm_begin
 
-        ++i[0];
-        i[1] = rand_r(&seed);
+        produced = false;
 
-        printf("Storing i0=%d, i1=%d\n", i[0], i[1]);
+        long* buf = NULL;
+        load((uintptr_t)&slot->buf, &buf, sizeof(buf));
 
-        tm_begin
+        if (!buf) {
 
-            int* buf = NULL;
-            load((uintptr_t)&g_i, &buf, sizeof(g_i));
+            buf = malloc_tx(2 * sizeof(*buf));
+            buf[0] = value;
+            buf[1] = checksum(value);
 
-            if (!buf) {
+            store((uintptr_t)&slot->buf, &buf, sizeof(buf));
 
-                buf = malloc_tx(2 * sizeof(*buf));
-                buf[0] = i[0];
-                buf[1] = i[1];
+            produced = true;
+        }
 
-                store((uintptr_t)&g_i, &buf, sizeof(g_i));
-            }
+    tm_commit
+        recover_from_errno(tm_recovery_errno());
+        tm_restart();
+    tm_end
 
-        tm_commit
-            recover_from_errno(tm_recovery_errno());
-            tm_restart();
-        tm_end
-    }
+    return produced;
 }
 
 static void
-verify_load(int i0, int i1)
+verify_buf(long i0, long i1)
 {
-    unsigned int seed = 1;
+    if (i1 != checksum(i0)) {
+        fprintf(stderr, "Incorrect value pair (%ld,%ld), should be (%ld,%ld)\n",
+                i0, i1, i0, checksum(i0));
+        __atomic_add_fetch(&g_nerrors, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Returns true if the consumer emptied a slot. */
+static bool
+consume(struct worker* worker)
+{
+    struct slot* slot = g_slot + bench_rand_below(&worker->rand, g_config.nslots);
+
+    tm_save long i[2] = {0, 0};
+    tm_save bool consumed = false;
+
+    tm_begin
+
+        consumed = false;
+
+        long* buf = NULL;
+        load((uintptr_t)&slot->buf, &buf, sizeof(buf));
+
+        if (buf) {
+            i[0] = buf[0];
+            i[1] = buf[1];
+
+            free_tx(buf);
+
+            buf = NULL;
+            store((uintptr_t)&slot->buf, &buf, sizeof(buf));
 
-    int i;
-    int value = 0;
+            consumed = true;
+        }
 
-    for (i = 0; i < i0; ++i) {
-        value = rand_r(&seed);
+    tm_commit
+        recover_from_errno(tm_recovery_errno());
+        tm_restart();
+    tm_end
+
+    if (consumed) {
+        verify_buf(i[0], i[1]);
     }
 
-    if (value != i1) {
-        printf("Incorrect value pair (%d,%d), should be (%d,%d)\n",
-               i0, i1, i, value);
+    return consumed;
+}
+
+static void
+wait_for_threads(void)
+{
+    if (bench_barrier_wait(&g_barrier)) {
+        g_begin_ns = bench_now_ns();
+        g_deadline_ns = g_begin_ns + (uint64_t)(g_config.seconds * 1e9);
     }
+
+    /* Wait until the deadline has been set. */
+    bench_barrier_wait(&g_barrier);
 }
 
 static void
-consumer_func(void)
+worker_func(unsigned long index, void* arg)
 {
+    struct worker* worker = g_worker + index;
+
+    bool (*func)(struct worker*) = index < g_nproducers ? produce : consume;
+
+    wait_for_threads();
+
+    uint64_t deadline_ns = g_deadline_ns;
+
     while (true) {
 
-        sleep(1);
+        unsigned long i;
+        for (i = 0; i < DEADLINE_INTERVAL; ++i) {
+            worker->nitems += func(worker);
+            ++worker->commits;
+            bench_spin_ns(g_config.think_ns);
+        }
+
+        uint64_t now = bench_now_ns();
+        if (now >= deadline_ns) {
+            worker->end_ns = now;
+            break;
+        }
+    }
+}
 
-        int i[2] = {0, 0};
+/* Returns the number of filled slots. */
+static unsigned long
+filled_slots(void)
+{
+    unsigned long nfilled = 0;
 
-        tm_begin
+    unsigned long i;
+    for (i = 0; i < g_config.nslots; ++i) {
+        nfilled += !!g_slot[i].buf;
+    }
 
-            int* buf = NULL;
-            load((uintptr_t)&g_i, &buf, sizeof(g_i));
+    return nfilled;
+}
 
-            if (buf) {
-                i[0] = buf[0];
-                i[1] = buf[1];
+/* Runs one step of the sweep and prints its results. Returns 0 on
+ * success, or -1 on errors. */
+static int
+run_step(unsigned long nproducers, unsigned long nconsumers)
+{
+    unsigned long nthreads = nproducers + nconsumers;
 
-                verify_load(i[0], i[1]);
+    g_worker = bench_calloc_aligned(nthreads, sizeof(*g_worker),
+                                    __alignof__(*g_worker));
 
-                free_tx(buf);
+    unsigned long i;
+    for (i = 0; i < nthreads; ++i) {
+        bench_rand_init(&g_worker[i].rand, i + 1);
+    }
+    g_nproducers = nproducers;
 
-                buf = NULL;
-                store((uintptr_t)&g_i, &buf, sizeof(g_i));
-            }
+    int err = pthread_barrier_init(&g_barrier, NULL, nthreads);
+    if (err) {
+        errno = err;
+        perror("pthread_barrier_init");
+        goto err_pthread_barrier_init;
+    }
 
-        tm_commit
-            recover_from_errno(tm_recovery_errno());
-            tm_restart();
-        tm_end
+    unsigned long nfilled = filled_slots();
+    unsigned long aborts = bench_total_aborts(NULL);
+
+    bench_run_threads(nthreads, g_config.pin, worker_func, NULL);
+
+    aborts = bench_total_aborts(NULL) - aborts;
+
+    pthread_barrier_destroy(&g_barrier);
+
+    unsigned long commits = 0;
+    unsigned long produced = 0;
+    unsigned long consumed = 0;
+    unsigned long min_commits = ~0ul;
+    unsigned long max_commits = 0;
+    uint64_t end_ns = g_begin_ns;
+    double sum_squares = 0;
+
+    for (i = 0; i < nthreads; ++i) {
+
+        const struct worker* worker = g_worker + i;
+
+        commits += worker->commits;
+        if (i < nproducers) {
+            produced += worker->nitems;
+        } else {
+            consumed += worker->nitems;
+        }
+        if (worker->commits < min_commits) {
+            min_commits = worker->commits;
+        }
+        if (worker->commits > max_commits) {
+            max_commits = worker->commits;
+        }
+        if (worker->end_ns > end_ns) {
+            end_ns = worker->end_ns;
+        }
+        sum_squares += (double)worker->commits * worker->commits;
+    }
 
-        printf("Loaded i0=%d, i1=%d\n", i[0], i[1]);
+    /* Every item is either consumed or still in the queue. */
+    if (nfilled + produced != consumed + filled_slots()) {
+        fprintf(stderr, "Lost items: %lu filled slots + %lu produced != "
+                        "%lu consumed + %lu filled slots\n",
+                nfilled, produced, consumed, filled_slots());
+        __atomic_add_fetch(&g_nerrors, 1, __ATOMIC_RELAXED);
     }
-}
 
-static void*
-producer_func_cb(void* arg)
-{
-    producer_func();
-    return NULL;
+    double seconds = (end_ns - g_begin_ns) / 1e9;
+
+    /* Jain's index is 1 if all threads committed equally often,
+     * and 1/nthreads if one thread did all the work. */
+    double fairness = sum_squares ?
+        (double)commits * commits / (nthreads * sum_squares) : 0;
+
+    printf("%lu,%lu,%.3f,%lu,%.0f,%lu,%.4f,%lu,%lu,%.4f,%lu,%lu\n",
+           nproducers, nconsumers, seconds, commits, commits / seconds,
+           aborts, commits + aborts ? (double)aborts / (commits + aborts) : 0,
+           produced, consumed, fairness, min_commits, max_commits);
+    fflush(stdout);
+
+    free(g_worker);
+
+    return 0;
+
+err_pthread_barrier_init:
+    free(g_worker);
+    return -1;
 }
 
-static void*
-consumer_func_cb(void* arg)
+static void
+usage(const char* prog)
 {
-    consumer_func();
-    return NULL;
+    fprintf(stderr,
+            "Usage: %s [-p PRODUCERS] [-c CONSUMERS] [-x SCALES] [-d SECONDS]\n"
+            "          [-k THINK_NS] [-q SLOTS] [-u] [-r]\n"
+            "SCALES is a comma-separated list of factors, e.g., 1,2,4,8.\n",
+            prog);
 }
 
 int
 main(int argc, char* argv[])
 {
-    pthread_t consumer;
-    int err = pthread_create(&consumer, NULL, consumer_func_cb, NULL);
-    if (err) {
-        errno = err;
-        perror("pthread_create");
-        goto err_pthread_create_consumer;
+    g_config.nproducers = 1;
+    g_config.nconsumers = 1;
+    g_config.scales = "1,2,4,8";
+    g_config.seconds = 1;
+    g_config.think_ns = 0;
+    g_config.nslots = 1;
+    g_config.pin = true;
+    g_config.report = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:x:d:k:q:urh")) != -1) {
+        switch (opt) {
+            case 'p':
+                g_config.nproducers = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                g_config.nconsumers = strtoul(optarg, NULL, 0);
+                break;
+            case 'x':
+                g_config.scales = optarg;
+                break;
+            case 'd':
+                g_config.seconds = strtod(optarg, NULL);
+                break;
+            case 'k':
+                g_config.think_ns = strtoull(optarg, NULL, 0);
+                break;
+            case 'q':
+                g_config.nslots = strtoul(optarg, NULL, 0);
+                break;
+            case 'u':
+                g_config.pin = false;
+                break;
+            case 'r':
+                g_config.report = true;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
     }
 
-    pthread_t producer;
-    err = pthread_create(&producer, NULL, producer_func_cb, NULL);
-    if (err) {
-        errno = err;
-        perror("pthread_create");
-        goto err_pthread_create_producer;
+    if ((!g_config.nproducers && !g_config.nconsumers) || !g_config.nslots ||
+        (g_config.seconds <= 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
     }
 
-    err = pthread_join(producer, NULL);
-    if (err) {
-        errno = err;
-        perror("pthread_join");
+    g_slot = bench_calloc_aligned(g_config.nslots, sizeof(*g_slot),
+                                  __alignof__(*g_slot));
+
+    printf("producers,consumers,seconds,commits,commits_per_sec,aborts,"
+           "abort_ratio,produced,consumed,fairness,min_commits,max_commits\n");
+
+    const char* scale = g_config.scales;
+
+    while (*scale) {
+
+        char* end;
+        unsigned long factor = strtoul(scale, &end, 0);
+        if ((end == scale) || !factor) {
+            usage(argv[0]);
+            goto err_scale;
+        }
+
+        if (run_step(factor * g_config.nproducers,
+                     factor * g_config.nconsumers) < 0) {
+            goto err_run_step;
+        }
+
+        scale = *end == ',' ? end + 1 : end;
     }
-    err = pthread_join(consumer, NULL);
-    if (err) {
-        errno = err;
-        perror("pthread_join");
+
+    if (g_config.report) {
+        tm_site_report(stderr);
     }
 
-    return EXIT_SUCCESS;
+    free(g_slot);
 
-err_pthread_create_producer:
-    err = pthread_join(consumer, NULL);
-    if (err) {
-        errno = err;
-        perror("pthread_join");
+    if (g_nerrors) {
+        fprintf(stderr, "%lu errors\n", g_nerrors);
+        return EXIT_FAILURE;
     }
-err_pthread_create_consumer:
+
+    return EXIT_SUCCESS;
+
+err_run_step:
+err_scale:
+    free(g_slot);
     return EXIT_FAILURE;
 }
@@ -0,0 +1,161 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "redo.h"
+#include "array.h"
+#include "blend.h"
+
+/* Redo log and its hash index of positions plus one */
+static __thread struct stripe* t_redo;
+__thread unsigned long         t_nredos;
+static __thread unsigned long  t_redocap;
+static __thread unsigned long* t_index;
+static __thread unsigned long  t_index_bitshift;
+
+void
+stripe_store(const struct stripe* stripe)
+{
+    store_masked((void*)stripe->base, stripe->value,
+                 stripe->bits, arraylen(stripe->bits), 0, STRIPE_NBYTES);
+}
+
+static unsigned long*
+find_index(uintptr_t base)
+{
+    unsigned long bitmask = (1ul << t_index_bitshift) - 1;
+
+    uint64_t hash = (base >> STRIPE_BITSHIFT) * 0x9e3779b97f4a7c15ul;
+    unsigned long i = hash >> (64 - t_index_bitshift);
+
+    while (t_index[i] && t_redo[t_index[i] - 1].base != base) {
+        i = (i + 1) & bitmask;
+    }
+
+    return t_index + i;
+}
+
+static void
+grow_index(void)
+{
+    free(t_index);
+
+    t_index_bitshift = t_index_bitshift ? t_index_bitshift + 1 : 7;
+
+    t_index = calloc(1ul << t_index_bitshift, sizeof(*t_index));
+    if (!t_index) {
+        perror("calloc");
+        abort(); /* We cannot track the transaction; let's abort for now. */
+    }
+
+    unsigned long i;
+    for (i = 0; i < t_nredos; ++i) {
+        *find_index(t_redo[i].base) = i + 1;
+    }
+}
+
+struct stripe*
+_redo_find_slow(uintptr_t base)
+{
+    unsigned long pos = *find_index(base);
+
+    return pos ? t_redo + pos - 1 : NULL;
+}
+
+static struct stripe*
+find_or_append(uintptr_t base)
+{
+    /* Keep the index at most half full. */
+    if (2 * (t_nredos + 1) > (1ul << t_index_bitshift)) {
+        grow_index();
+    }
+
+    unsigned long* index = find_index(base);
+
+    if (*index) {
+        return t_redo + *index - 1;
+    }
+
+    if (t_nredos == t_redocap) {
+        t_redo = arraygrow(t_redo, &t_redocap, sizeof(*t_redo));
+    }
+
+    struct stripe* stripe = t_redo + t_nredos;
+    stripe_init(stripe, base);
+
+    ++t_nredos;
+    *index = t_nredos;
+
+    return stripe;
+}
+
+void
+redo_store(uintptr_t addr, const void* buf, size_t siz)
+{
+    const uint8_t* mem = (const uint8_t*)buf;
+
+    while (siz) {
+
+        struct stripe* stripe = find_or_append(addr & ~STRIPE_BITMASK);
+
+        unsigned long index = addr & STRIPE_BITMASK;
+        size_t len = min_size(siz, STRIPE_NBYTES - index);
+
+        copy_bytes(stripe->value + index, mem, len);
+        bitmask_set_range(stripe->bits, index, len);
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+void
+redo_blend(uintptr_t addr, void* buf, size_t siz)
+{
+    uint8_t* mem = (uint8_t*)buf;
+
+    while (t_nredos && siz) {
+
+        unsigned long index = addr & STRIPE_BITMASK;
+        size_t len = min_size(siz, STRIPE_NBYTES - index);
+
+        const struct stripe* stripe = redo_find(addr & ~STRIPE_BITMASK);
+        if (stripe) {
+            blend_bytes(mem, stripe->value + index,
+                        stripe->bits, arraylen(stripe->bits), index, len);
+        }
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+struct stripe*
+redo_beg()
+{
+    return t_redo;
+}
+
+struct stripe*
+redo_end()
+{
+    return t_redo + t_nredos;
+}
+
+void
+redo_clear()
+{
+    while (t_nredos) {
+        --t_nredos;
+        *find_index(t_redo[t_nredos].base) = 0;
+    }
+}
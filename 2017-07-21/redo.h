@@ -0,0 +1,99 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitmask.h"
+
+/* Conflict-detection granularity; override with -DSTRIPE_BITSHIFT
+ * from 3 (8 bytes) to 7 (128 bytes). */
+#ifndef STRIPE_BITSHIFT
+#define STRIPE_BITSHIFT     (3)
+#endif
+#define STRIPE_NBYTES       (1ul << STRIPE_BITSHIFT)
+#define STRIPE_BITMASK      ((1ul << STRIPE_BITSHIFT) - 1)
+
+/**
+ * Bytes of an aligned stripe of memory; only bytes with their bit
+ * set are valid.
+ */
+struct stripe {
+    uintptr_t base;
+    uint64_t  bits[BITMASK_NWORDS(STRIPE_NBYTES)];
+    uint8_t   value[STRIPE_NBYTES];
+};
+
+static inline void
+stripe_init(struct stripe* stripe, uintptr_t base)
+{
+    stripe->base = base;
+    bitmask_clear(stripe->bits, BITMASK_NWORDS(STRIPE_NBYTES));
+}
+
+/**
+ * Writes the valid bytes of a stripe to memory.
+ */
+void
+stripe_store(const struct stripe* stripe);
+
+/*
+ * Redo log
+ *
+ * Each thread buffers its transactional stores in a redo log with
+ * one entry per stripe.
+ */
+
+/* Number of entries in the current thread's redo log. Don't use
+ * directly; call redo_find() instead. */
+extern __thread unsigned long t_nredos;
+
+struct stripe*
+_redo_find_slow(uintptr_t base);
+
+/**
+ * Returns the current thread's entry for the stripe at base, or
+ * NULL if there is none.
+ */
+static inline struct stripe*
+redo_find(uintptr_t base)
+{
+    if (!t_nredos) {
+        return NULL;
+    }
+    return _redo_find_slow(base);
+}
+
+/**
+ * Buffers a store in the current thread's redo log.
+ */
+void
+redo_store(uintptr_t addr, const void* buf, size_t siz);
+
+/**
+ * Merges the current thread's buffered stores for the memory at addr
+ * into buf, which holds a copy of that memory.
+ */
+void
+redo_blend(uintptr_t addr, void* buf, size_t siz);
+
+struct stripe*
+redo_beg(void);
+
+struct stripe*
+redo_end(void);
+
+/**
+ * Empties the current thread's redo log.
+ */
+void
+redo_clear(void);
@@ -11,123 +11,527 @@
 
 #include "res.h"
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "array.h"
+#include "blend.h"
+#include "conflict.h"
+#include "thread.h"
+#include "trace.h"
 
-struct resource g_resource[NRESOURCES];
+/**
+ * A table of resource sets.
+ */
+struct resource_table {
+    unsigned long        nsets_bitshift;
+    struct resource_set* set;
+    /* Set once no thread uses an older table */
+    bool                 ready;
+};
 
-static struct resource*
-find_resource(uintptr_t base)
+static struct resource_table* g_resource_table;
+
+static pthread_once_t  g_resource_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_resource_resize_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Per-thread state, each on its own cache line */
+static struct {
+    struct resource_stats  stats;
+    /* The table used by the thread's current transaction, if any */
+    struct resource_table* active;
+} __attribute__((aligned(64))) g_resource_thread[NTHREADS];
+
+/* The table used by the current thread's transaction */
+static __thread struct resource_table* t_table;
+
+/* Resources acquired by the current thread */
+static __thread struct resource** t_acquired;
+static __thread unsigned long     t_nacquired;
+static __thread unsigned long     t_acquiredcap;
+
+__thread struct resource* t_resource_cache[RESOURCE_CACHE_NENTRIES];
+
+/* Statistics at the last check of the aliasing rate */
+static __thread unsigned long t_checked_claims;
+static __thread unsigned long t_checked_aliased;
+
+/*
+ * Table management
+ */
+
+static unsigned long
+nresources_bitshift(unsigned long nresources)
 {
-    unsigned long element = (base >> RESOURCE_BITSHIFT) & NRESOURCES_BITMASK;
+    unsigned long bitshift = RESOURCE_NWAYS_BITSHIFT + 1;
 
-    return g_resource + element;
+    while ((bitshift < NRESOURCES_MAX_BITSHIFT) &&
+           ((1ul << bitshift) < nresources)) {
+        ++bitshift;
+    }
+
+    return bitshift;
 }
 
-struct resource*
-acquire_resource(uintptr_t base)
+static struct resource_table*
+new_resource_table(unsigned long nresources_bitshift)
+{
+    struct resource_table* table = calloc(1, sizeof(*table));
+    if (!table) {
+        perror("calloc");
+        abort(); /* We cannot create the table; let's abort for now. */
+    }
+
+    table->nsets_bitshift = nresources_bitshift - RESOURCE_NWAYS_BITSHIFT;
+
+    table->set = calloc(1ul << table->nsets_bitshift, sizeof(*table->set));
+    if (!table->set) {
+        perror("calloc");
+        abort(); /* We cannot create the table; let's abort for now. */
+    }
+
+    return table;
+}
+
+static void
+free_resource_table(struct resource_table* table)
+{
+    struct resource_set* beg = table->set;
+    struct resource_set* end = table->set + (1ul << table->nsets_bitshift);
+
+    for (; beg < end; ++beg) {
+        struct resource_set* next = beg->next;
+        while (next) {
+            struct resource_set* overflow = next;
+            next = next->next;
+            free(overflow);
+        }
+    }
+
+    free(table->set);
+    free(table);
+}
+
+static void
+init_resource_table(void)
+{
+    unsigned long nresources = NRESOURCES;
+
+    const char* env = getenv("SIMPLETM_NRESOURCES");
+    if (env) {
+        nresources = strtoul(env, NULL, 0);
+    }
+
+    struct resource_table* table =
+        new_resource_table(nresources_bitshift(nresources));
+    table->ready = true;
+
+    __atomic_store_n(&g_resource_table, table, __ATOMIC_SEQ_CST);
+}
+
+static struct resource_table*
+get_resource_table(void)
 {
-    struct resource* res = find_resource(base);
+    struct resource_table* table =
+        __atomic_load_n(&g_resource_table, __ATOMIC_SEQ_CST);
 
-    pthread_t self = pthread_self();
+    if (__builtin_expect(!!table, 1)) {
+        return table;
+    }
 
-    int err = pthread_mutex_lock(&res->lock);
+    int err = pthread_once(&g_resource_once, init_resource_table);
     if (err) {
         errno = err;
-        perror("pthread_mutex_lock");
-        goto err_pthread_mutex_lock;
+        perror("pthread_once");
+        abort();
     }
 
-    if (res->owner && res->owner != self) {
-        /* Owned by another thread. */
-        goto err_has_owner;
+    return __atomic_load_n(&g_resource_table, __ATOMIC_SEQ_CST);
+}
 
-    } else if (res->owner && res->owner == self) {
-        /* Owned by us. */
-        if (base != res->base) {
-            abort(); /* We cannot re-use the resource with a different base. */
-        }
+/* Makes the current resource table the current thread's table. */
+static void
+enter_resource_table(uint64_t self)
+{
+    struct resource_table* table;
 
-    } else if (!res->owner) {
-        /* Now owned by us. */
-        res->base = base;
-        res->owner = self;
+    /* A concurrent resize either sees our table as active, or we see
+     * its new table. */
+    do {
+        table = get_resource_table();
+        __atomic_store_n(&g_resource_thread[self].active, table,
+                         __ATOMIC_SEQ_CST);
+    } while (table != __atomic_load_n(&g_resource_table, __ATOMIC_SEQ_CST));
+
+    /* Wait until no thread uses an older table. */
+    while (!__atomic_load_n(&table->ready, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
     }
 
-    err = pthread_mutex_unlock(&res->lock);
+    t_table = table;
+}
+
+static void
+leave_resource_table(uint64_t self)
+{
+    __atomic_store_n(&g_resource_thread[self].active, NULL, __ATOMIC_RELEASE);
+
+    t_table = NULL;
+}
+
+/* Replaces the table old by a table with the given number of resources.
+ * Threads with transactions on the old table restart on their next
+ * access to a resource; new transactions wait until all transactions
+ * on the old table finished. */
+static void
+resize_resource_table(struct resource_table* old,
+                      unsigned long nresources_bitshift)
+{
+    int err = pthread_mutex_lock(&g_resource_resize_lock);
     if (err) {
         errno = err;
-        perror("pthread_mutex_unlock");
-        abort(); /* We cannot release; let's abort for now. */
+        perror("pthread_mutex_lock");
+        abort();
     }
 
-    return res;
+    if ((old != __atomic_load_n(&g_resource_table, __ATOMIC_SEQ_CST)) ||
+        (nresources_bitshift ==
+            old->nsets_bitshift + RESOURCE_NWAYS_BITSHIFT)) {
+        goto out; /* Resized by another thread, or nothing to do. */
+    }
+
+    struct resource_table* table = new_resource_table(nresources_bitshift);
 
-err_has_owner:
-    /* fall through */
-err_pthread_mutex_lock:
-    err = pthread_mutex_unlock(&res->lock);
+    __atomic_store_n(&g_resource_table, table, __ATOMIC_SEQ_CST);
+
+    unsigned long i;
+    for (i = 0; i < arraylen(g_resource_thread); ++i) {
+        while (__atomic_load_n(&g_resource_thread[i].active, __ATOMIC_SEQ_CST) == old) {
+            cpu_relax();
+        }
+    }
+
+    __atomic_store_n(&table->ready, true, __ATOMIC_RELEASE);
+
+    free_resource_table(old);
+
+out:
+    err = pthread_mutex_unlock(&g_resource_resize_lock);
     if (err) {
         errno = err;
         perror("pthread_mutex_unlock");
-        abort(); /* We cannot release; let's abort for now. */
+        abort();
+    }
+}
+
+/* Doubles the table if too many of the thread's recent claims aliased. */
+static void
+check_aliasing_rate(uint64_t self, struct resource_table* table)
+{
+    const struct resource_stats* stats = &g_resource_thread[self].stats;
+
+    unsigned long claims = stats->claims - t_checked_claims;
+    if (claims < RESOURCE_GROW_NCLAIMS) {
+        return;
+    }
+
+    unsigned long aliased = stats->aliased - t_checked_aliased;
+
+    t_checked_claims = stats->claims;
+    t_checked_aliased = stats->aliased;
+
+    unsigned long bitshift = table->nsets_bitshift + RESOURCE_NWAYS_BITSHIFT;
+
+    if ((aliased * RESOURCE_GROW_ALIAS_DIVISOR > claims) &&
+        (bitshift < NRESOURCES_MAX_BITSHIFT)) {
+        resize_resource_table(table, bitshift + 1);
     }
-    return NULL;
 }
 
 void
-release_resource(struct resource* res, bool commit)
+resize_resources(unsigned long nresources)
 {
-    pthread_t self = pthread_self();
+    resize_resource_table(get_resource_table(),
+                          nresources_bitshift(nresources));
+}
 
-    int err = pthread_mutex_lock(&res->lock);
-    if (err) {
-        errno = err;
-        perror("pthread_mutex_lock");
-        abort(); /* We cannot release; let's abort for now. */
+/*
+ * Resources
+ */
+
+static struct resource_set*
+find_resource_set(const struct resource_table* table, uintptr_t base)
+{
+    uint64_t hash = (base >> RESOURCE_BITSHIFT) * 0x9e3779b97f4a7c15ul;
+
+    return table->set + (hash >> (64 - table->nsets_bitshift));
+}
+
+static unsigned long
+resource_owner(const struct resource* res)
+{
+    uint64_t ownership = __atomic_load_n(&res->ownership, __ATOMIC_ACQUIRE);
+
+    return ownership_field(ownership, OWNERSHIP_OWNER_BITSHIFT,
+                                      OWNERSHIP_OWNER_BITMASK);
+}
+
+/* Looks up the resource for base in the set and its overflow
+ * sets. Returns true if the resource is owned by any thread. */
+static bool
+lookup_resource(struct resource_set* set, uintptr_t base,
+                struct resource** res_out, unsigned long* owner_out)
+{
+    for (; set; set = __atomic_load_n(&set->next, __ATOMIC_ACQUIRE)) {
+
+        struct resource* beg = arraybeg(set->way);
+        struct resource* end = arrayend(set->way);
+
+        for (; beg < end; ++beg) {
+            unsigned long owner = resource_owner(beg);
+            if (owner &&
+                (__atomic_load_n(&beg->base, __ATOMIC_RELAXED) == base)) {
+                *res_out = beg;
+                *owner_out = owner;
+                return true;
+            }
+        }
     }
 
-    if (res->owner && res->owner == self) {
+    return false;
+}
+
+static void
+lock_resource_set(struct resource_set* set)
+{
+    while (__atomic_exchange_n(&set->lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&set->lock, __ATOMIC_RELAXED)) {
+            cpu_relax();
+        }
+    }
+}
+
+static void
+unlock_resource_set(struct resource_set* set)
+{
+    __atomic_store_n(&set->lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Claims a free resource for base. Only call with the set locked. */
+static struct resource*
+claim_resource(struct resource_set* set, uintptr_t base, uint64_t self)
+{
+    struct resource_set* home = set;
+
+    struct resource_stats* stats = &g_resource_thread[self].stats;
 
-        if (res->local_bits) {
+    ++stats->claims;
 
-            /* We have to store if we either commit in write-back
-             * mode, or revert in write-through mode.
-             */
-            bool store_local_bits = commit != !!(res->flags & RESOURCE_FLAG_WRITE_THROUGH);
+    bool aliased = false;
 
-            if (store_local_bits) {
-                unsigned long bit = 1ul;
+    while (true) {
 
-                uint8_t* mem = (uint8_t*)res->base;
-                uint8_t* beg = arraybeg(res->local_value);
-                uint8_t* end = arrayend(res->local_value);
+        struct resource* beg = arraybeg(set->way);
+        struct resource* end = arrayend(set->way);
 
-                while (beg < end) {
-                    if (res->local_bits & bit) {
-                        *mem = *beg;
-                    }
-                    bit <<= 1;
-                    ++mem;
-                    ++beg;
+        for (; beg < end; ++beg) {
+            if (!resource_owner(beg)) {
+                /* Free resources only change under the set's lock. */
+                __atomic_store_n(&beg->base, base, __ATOMIC_RELAXED);
+                __atomic_store_n(&beg->ownership,
+                                 self << OWNERSHIP_OWNER_BITSHIFT,
+                                 __ATOMIC_RELEASE);
+                if (aliased) {
+                    ++stats->aliased;
+                    conflict_record_alias(home - t_table->set);
                 }
+                return beg;
             }
+            aliased = true;
+        }
 
-            res->local_bits = 0;
-            res->flags = 0;
+        struct resource_set* next = set->next;
+
+        if (!next) {
+            next = calloc(1, sizeof(*next));
+            if (!next) {
+                perror("calloc");
+                abort(); /* We cannot extend the set; let's abort for now. */
+            }
+            __atomic_store_n(&set->next, next, __ATOMIC_RELEASE);
         }
 
-        res->owner = 0;
+        if (set == home) {
+            ++stats->overflows;
+        }
+        set = next;
     }
+}
 
-    err = pthread_mutex_unlock(&res->lock);
-    if (err) {
-        errno = err;
-        perror("pthread_mutex_unlock");
-        abort(); /* We cannot release; let's abort for now. */
+struct resource*
+acquire_resource(uintptr_t base)
+{
+    uint64_t self = thread_id();
+
+    if (!t_table) {
+        enter_resource_table(self);
+    } else if (t_table != __atomic_load_n(&g_resource_table, __ATOMIC_RELAXED)) {
+        return NULL; /* The table has been resized; restart. */
+    }
+
+    struct resource_set* set = find_resource_set(t_table, base);
+
+    struct resource* res;
+    unsigned long owner;
+
+    if (lookup_resource(set, base, &res, &owner)) {
+        /* Owned by us, or by another thread. */
+        if (owner != self) {
+            conflict_record(base, set - t_table->set, owner);
+            trace_record(TRACE_CONFLICT, base, owner);
+            return NULL;
+        }
+        *resource_cache_entry(base) = res;
+        return res;
     }
+
+    lock_resource_set(set);
+
+    /* Another thread might have claimed base in the meantime. */
+    bool owned = lookup_resource(set, base, &res, &owner);
+    if (!owned) {
+        res = claim_resource(set, base, self);
+    }
+
+    unlock_resource_set(set);
+
+    if (owned && (owner != self)) {
+        conflict_record(base, set - t_table->set, owner);
+        trace_record(TRACE_CONFLICT, base, owner);
+        return NULL;
+    } else if (owned) {
+        return res;
+    }
+
+    /* Now owned by us. */
+    if (t_nacquired == t_acquiredcap) {
+        t_acquired = arraygrow(t_acquired, &t_acquiredcap,
+                               sizeof(*t_acquired));
+    }
+    t_acquired[t_nacquired] = res;
+    ++t_nacquired;
+
+    *resource_cache_entry(base) = res;
+
+    trace_record(TRACE_ACQUIRE, base, set - t_table->set);
+
+    return res;
+}
+
+bool
+resource_table_resized()
+{
+    return t_table &&
+        (t_table != __atomic_load_n(&g_resource_table, __ATOMIC_RELAXED));
 }
 
+unsigned long
+acquired_resources()
+{
+    return t_nacquired;
+}
+
+size_t
+release_resource(struct resource* res, bool commit)
+{
+    uint64_t self = thread_id();
+
+    uint64_t ownership = __atomic_load_n(&res->ownership, __ATOMIC_RELAXED);
+
+    unsigned long owner = ownership_field(ownership,
+                                          OWNERSHIP_OWNER_BITSHIFT,
+                                          OWNERSHIP_OWNER_BITMASK);
+    if (owner != self) {
+        return 0;
+    }
+
+    size_t nstored = 0;
+
+    struct resource** entry = resource_cache_entry(res->base);
+    if (*entry == res) {
+        *entry = NULL;
+    }
+
+    uint8_t flags = ownership_field(ownership,
+                                    OWNERSHIP_FLAGS_BITSHIFT,
+                                    OWNERSHIP_FLAGS_BITMASK);
+
+    if (!bitmask_is_empty(res->local_bits, arraylen(res->local_bits))) {
+
+        /* We have to store if we either commit in write-back
+         * mode, or revert in write-through mode.
+         */
+        bool store_local_bits = commit != !!(flags & RESOURCE_FLAG_WRITE_THROUGH);
+
+        if (store_local_bits) {
+            store_masked((void*)res->base, res->local_value,
+                         res->local_bits, arraylen(res->local_bits),
+                         0, RESOURCE_NBYTES);
+            nstored = bitmask_count(res->local_bits,
+                                    arraylen(res->local_bits));
+        }
+
+        bitmask_clear(res->local_bits, arraylen(res->local_bits));
+    }
 
+    /* Clears the flags, and makes the stored values
+     * visible to the next owner. */
+    __atomic_store_n(&res->ownership, 0, __ATOMIC_RELEASE);
+
+    return nstored;
+}
+
+size_t
+release_resources(bool commit)
+{
+    struct resource** beg = t_acquired;
+    struct resource** end = t_acquired + t_nacquired;
+
+    size_t nstored = 0;
+
+    while (beg < end) {
+        nstored += release_resource(*beg, commit);
+        ++beg;
+    }
+
+    t_nacquired = 0;
+
+    struct resource_table* table = t_table;
+
+    if (table) {
+        uint64_t self = thread_id();
+        leave_resource_table(self);
+        check_aliasing_rate(self, table);
+    }
+
+    return nstored;
+}
+
+void
+resource_stats(struct resource_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    const struct resource_table* table = get_resource_table();
+
+    stats->nresources = 1ul << (table->nsets_bitshift + RESOURCE_NWAYS_BITSHIFT);
+
+    unsigned long i;
+    for (i = 0; i < arraylen(g_resource_thread); ++i) {
+        const struct resource_stats* thread_stats = &g_resource_thread[i].stats;
+        stats->claims    += __atomic_load_n(&thread_stats->claims, __ATOMIC_RELAXED);
+        stats->aliased   += __atomic_load_n(&thread_stats->aliased, __ATOMIC_RELAXED);
+        stats->overflows += __atomic_load_n(&thread_stats->overflows, __ATOMIC_RELAXED);
+    }
+}
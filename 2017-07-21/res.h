@@ -11,38 +11,201 @@
 
 #pragma once
 
-#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "bitmask.h"
 
 #define BASE_BITMASK        (~RESOURCE_BITMASK)
 
+/* Conflict-detection granularity; override with -DRESOURCE_BITSHIFT
+ * from 3 (8 bytes) to 7 (128 bytes). */
+#ifndef RESOURCE_BITSHIFT
 #define RESOURCE_BITSHIFT   (3)
+#endif
 #define RESOURCE_NBYTES     (1ul << RESOURCE_BITSHIFT)
 #define RESOURCE_BITMASK    ((1ul << RESOURCE_BITSHIFT) - 1)
 
+/*
+ * Ownership word
+ *
+ * A resource's owner and flags are packed into a single 64-bit word,
+ * so a thread can acquire a resource with a single compare-and-swap.
+ * Only the owner modifies the flags.
+ */
+
+#define OWNERSHIP_OWNER_BITSHIFT        (0)
+#define OWNERSHIP_OWNER_BITMASK         (0xfffful)
+#define OWNERSHIP_FLAGS_BITSHIFT        (24)
+#define OWNERSHIP_FLAGS_BITMASK         (0xfful)
+
 /**
- * A value with an associated owner.
+ * A value with an associated owner. Only the owner accesses the
+ * local bits and value.
  */
 struct resource {
-    uintptr_t       base;
-    uint8_t         local_value[RESOURCE_NBYTES];
-    uint8_t         local_bits;
-    uint8_t         flags;
-    pthread_t       owner;
-    pthread_mutex_t lock;
+    uint64_t  ownership;
+    uintptr_t base;
+    uint64_t  local_bits[BITMASK_NWORDS(RESOURCE_NBYTES)];
+    uint8_t   local_value[RESOURCE_NBYTES];
 };
 
-#define NRESOURCES_BITSHIFT (10)
-#define NRESOURCES          (1ul << NRESOURCES_BITSHIFT)
-#define NRESOURCES_BITMASK  ((1ul << NRESOURCES_BITSHIFT) - 1)
-
 #define RESOURCE_FLAG_WRITE_THROUGH     (1ul)
 
-extern struct resource g_resource[NRESOURCES];
+/*
+ * Resource table
+ *
+ * Addresses hash to a set of resources. A resource is free if it has
+ * no owner; any free resource in the set can hold any address of the
+ * set. If all resources of a set are taken, the set is extended by an
+ * overflow set. Threads only conflict on resources with the same
+ * base.
+ *
+ * The table initially has NRESOURCES resources, or as many as set in
+ * the environment variable SIMPLETM_NRESOURCES. It doubles in size
+ * whenever more than 1 / RESOURCE_GROW_ALIAS_DIVISOR of a thread's
+ * last RESOURCE_GROW_NCLAIMS claims aliased.
+ */
+
+#define RESOURCE_NWAYS_BITSHIFT (2)
+#define RESOURCE_NWAYS          (1ul << RESOURCE_NWAYS_BITSHIFT)
+
+#define NRESOURCES_BITSHIFT     (10)
+#define NRESOURCES              (1ul << NRESOURCES_BITSHIFT)
+#define NRESOURCES_MAX_BITSHIFT (26)
+
+#define RESOURCE_GROW_NCLAIMS       (1ul << 12)
+#define RESOURCE_GROW_ALIAS_DIVISOR (4)
+
+/**
+ * A set of resources for addresses with the same hash.
+ */
+struct resource_set {
+    struct resource      way[RESOURCE_NWAYS];
+    struct resource_set* next;
+    /* Serializes claims of free resources */
+    uint8_t              lock;
+};
+
+/**
+ * Statistics of resource claims.
+ */
+struct resource_stats {
+    /* Current size of the table */
+    unsigned long nresources;
+    /* Number of free resources claimed */
+    unsigned long claims;
+    /* Number of claims for which another base held a resource
+     * in the same set */
+    unsigned long aliased;
+    /* Number of claims that went to an overflow set */
+    unsigned long overflows;
+};
+
+static inline unsigned long
+ownership_field(uint64_t ownership, unsigned long bitshift,
+                unsigned long bitmask)
+{
+    return (ownership >> bitshift) & bitmask;
+}
+
+static inline uint8_t
+resource_flags(const struct resource* res)
+{
+    uint64_t ownership = __atomic_load_n(&res->ownership, __ATOMIC_RELAXED);
+
+    return ownership_field(ownership, OWNERSHIP_FLAGS_BITSHIFT,
+                                      OWNERSHIP_FLAGS_BITMASK);
+}
+
+/* Only call the setter on resources owned by the current thread. */
+
+static inline void
+resource_or_flags(struct resource* res, uint8_t flags)
+{
+    uint64_t ownership = __atomic_load_n(&res->ownership, __ATOMIC_RELAXED);
+
+    ownership |= (uint64_t)flags << OWNERSHIP_FLAGS_BITSHIFT;
+
+    __atomic_store_n(&res->ownership, ownership, __ATOMIC_RELAXED);
+}
+
+/*
+ * Acquired resources
+ *
+ * Each thread caches the resources it acquired in a small direct-mapped
+ * table, so repeated accesses to a resource skip the table lookup.
+ */
+
+#define RESOURCE_CACHE_NENTRIES_BITSHIFT    (6)
+#define RESOURCE_CACHE_NENTRIES             (1ul << RESOURCE_CACHE_NENTRIES_BITSHIFT)
+#define RESOURCE_CACHE_NENTRIES_BITMASK     ((1ul << RESOURCE_CACHE_NENTRIES_BITSHIFT) - 1)
+
+/* Don't use directly; call find_acquired_resource() instead. */
+extern __thread struct resource* t_resource_cache[RESOURCE_CACHE_NENTRIES];
+
+static inline struct resource**
+resource_cache_entry(uintptr_t base)
+{
+    return t_resource_cache +
+        ((base >> RESOURCE_BITSHIFT) & RESOURCE_CACHE_NENTRIES_BITMASK);
+}
+
+/**
+ * Returns the resource for base if the current thread acquired it
+ * recently, or NULL otherwise.
+ */
+static inline struct resource*
+find_acquired_resource(uintptr_t base)
+{
+    struct resource* res = *resource_cache_entry(base);
 
+    return (res && (res->base == base)) ? res : NULL;
+}
+
+/**
+ * Returns the resource for base, owned by the current thread, or
+ * NULL if another thread owns it.
+ */
 struct resource*
 acquire_resource(uintptr_t base);
 
-void
+/**
+ * Returns true if the resource table changed during the current
+ * thread's transaction, so acquire_resource() fails.
+ */
+bool
+resource_table_resized(void);
+
+/**
+ * Returns the number of resources acquired by the current thread.
+ */
+unsigned long
+acquired_resources(void);
+
+/**
+ * Releases a resource; returns the number of bytes written back.
+ */
+size_t
 release_resource(struct resource* res, bool commit);
+
+/**
+ * Releases all resources acquired by the current thread; returns
+ * the number of bytes written back.
+ */
+size_t
+release_resources(bool commit);
+
+/**
+ * Resizes the resource table to at least the given number of
+ * resources. Don't call this function within a transaction.
+ */
+void
+resize_resources(unsigned long nresources);
+
+/**
+ * Returns the sum of all threads' resource statistics. The aliasing
+ * rate, aliased / claims, indicates if NRESOURCES is too small.
+ */
+void
+resource_stats(struct resource_stats* stats);
@@ -0,0 +1,170 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Hash set with a fixed number of chained buckets
+ */
+
+#include "set.h"
+#include <stdio.h>
+
+struct hash_node {
+    uint64_t          key;
+    struct hash_node* next;
+};
+
+struct hash {
+    /* nbuckets is a power of two. */
+    unsigned long      nbuckets;
+    struct hash_node** bucket;
+};
+
+/* Returns the link to the node with key, or to the end of its
+ * bucket's chain. */
+static inline struct hash_node**
+hash_find(struct hash* hash, uint64_t key, bool tx)
+{
+    /* The bucket array never changes; no need to load it
+     * transactionally. */
+    struct hash_node** link = hash->bucket + (set_mix(key) & (hash->nbuckets - 1));
+    struct hash_node* node = set_load(tx, link);
+
+    while (node && (set_load(tx, &node->key) != key)) {
+        link = &node->next;
+        node = set_load(tx, link);
+    }
+
+    return link;
+}
+
+static inline bool
+hash_contains(void* set, uint64_t key, bool tx)
+{
+    return !!set_load(tx, hash_find(set, key, tx));
+}
+
+static inline bool
+hash_insert(void* set, uint64_t key, bool tx)
+{
+    struct hash_node** link = hash_find(set, key, tx);
+
+    if (set_load(tx, link)) {
+        return false;
+    }
+
+    struct hash_node* node = set_malloc(tx, sizeof(*node));
+    node->key = key;
+    node->next = NULL;
+
+    set_store(tx, link, node);
+
+    return true;
+}
+
+static inline bool
+hash_remove(void* set, uint64_t key, bool tx)
+{
+    struct hash_node** link = hash_find(set, key, tx);
+    struct hash_node* node = set_load(tx, link);
+
+    if (!node) {
+        return false;
+    }
+
+    set_store(tx, link, set_load(tx, &node->next));
+    set_free(tx, node);
+
+    return true;
+}
+
+SET_DEFINE_OPS(hash)
+
+static void*
+hash_create(uint64_t key_range)
+{
+    struct hash* hash = calloc(1, sizeof(*hash));
+    if (!hash) {
+        perror("calloc");
+        abort();
+    }
+
+    /* About two buckets per key of a half-full set */
+    hash->nbuckets = 1;
+    while (hash->nbuckets < key_range) {
+        hash->nbuckets <<= 1;
+    }
+
+    hash->bucket = calloc(hash->nbuckets, sizeof(*hash->bucket));
+    if (!hash->bucket) {
+        perror("calloc");
+        abort();
+    }
+
+    return hash;
+}
+
+static void
+hash_destroy(void* set)
+{
+    struct hash* hash = set;
+
+    unsigned long i;
+    for (i = 0; i < hash->nbuckets; ++i) {
+        struct hash_node* node = hash->bucket[i];
+        while (node) {
+            struct hash_node* next = node->next;
+            set_free(false, node);
+            node = next;
+        }
+    }
+
+    free(hash->bucket);
+    free(hash);
+}
+
+static long
+hash_verify(void* set)
+{
+    const struct hash* hash = set;
+
+    long nkeys = 0;
+
+    unsigned long i;
+    for (i = 0; i < hash->nbuckets; ++i) {
+
+        const struct hash_node* node = hash->bucket[i];
+
+        for (; node; node = node->next, ++nkeys) {
+
+            if ((set_mix(node->key) & (hash->nbuckets - 1)) != i) {
+                return -1; /* Wrong bucket */
+            }
+
+            const struct hash_node* other = node->next;
+            for (; other; other = other->next) {
+                if (other->key == node->key) {
+                    return -1; /* Duplicate key */
+                }
+            }
+        }
+    }
+
+    return nkeys;
+}
+
+const struct set_type g_set_hash = {
+    "hash",
+    hash_create,
+    hash_destroy,
+    hash_verify,
+    SET_OPS_TX(hash),
+    SET_OPS_PLAIN(hash)
+};
@@ -0,0 +1,140 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Sorted linked list
+ */
+
+#include "set.h"
+#include <stdio.h>
+
+struct list_node {
+    uint64_t          key;
+    struct list_node* next;
+};
+
+struct list {
+    struct list_node* head;
+};
+
+/* Returns the link to the first node with a key of at least key. */
+static inline struct list_node**
+list_find(struct list* list, uint64_t key, bool tx)
+{
+    struct list_node** link = &list->head;
+    struct list_node* node = set_load(tx, link);
+
+    while (node && (set_load(tx, &node->key) < key)) {
+        link = &node->next;
+        node = set_load(tx, link);
+    }
+
+    return link;
+}
+
+static inline bool
+list_contains(void* set, uint64_t key, bool tx)
+{
+    struct list_node* node = set_load(tx, list_find(set, key, tx));
+
+    return node && (set_load(tx, &node->key) == key);
+}
+
+static inline bool
+list_insert(void* set, uint64_t key, bool tx)
+{
+    struct list_node** link = list_find(set, key, tx);
+    struct list_node* next = set_load(tx, link);
+
+    if (next && (set_load(tx, &next->key) == key)) {
+        return false;
+    }
+
+    /* The new node is private until we link it. */
+    struct list_node* node = set_malloc(tx, sizeof(*node));
+    node->key = key;
+    node->next = next;
+
+    set_store(tx, link, node);
+
+    return true;
+}
+
+static inline bool
+list_remove(void* set, uint64_t key, bool tx)
+{
+    struct list_node** link = list_find(set, key, tx);
+    struct list_node* node = set_load(tx, link);
+
+    if (!node || (set_load(tx, &node->key) != key)) {
+        return false;
+    }
+
+    set_store(tx, link, set_load(tx, &node->next));
+    set_free(tx, node);
+
+    return true;
+}
+
+SET_DEFINE_OPS(list)
+
+static void*
+list_create(uint64_t key_range)
+{
+    struct list* list = calloc(1, sizeof(*list));
+    if (!list) {
+        perror("calloc");
+        abort();
+    }
+
+    return list;
+}
+
+static void
+list_destroy(void* set)
+{
+    struct list* list = set;
+    struct list_node* node = list->head;
+
+    while (node) {
+        struct list_node* next = node->next;
+        set_free(false, node);
+        node = next;
+    }
+
+    free(list);
+}
+
+static long
+list_verify(void* set)
+{
+    const struct list* list = set;
+    const struct list_node* node = list->head;
+
+    long nkeys = 0;
+
+    for (; node; node = node->next, ++nkeys) {
+        if (node->next && (node->next->key <= node->key)) {
+            return -1; /* Not sorted */
+        }
+    }
+
+    return nkeys;
+}
+
+const struct set_type g_set_list = {
+    "list",
+    list_create,
+    list_destroy,
+    list_verify,
+    SET_OPS_TX(list),
+    SET_OPS_PLAIN(list)
+};
@@ -0,0 +1,446 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Red-black tree
+ *
+ * The tree follows Cormen et al., with NULL instead of a shared
+ * sentinel leaf, which concurrent transactions would all write.
+ */
+
+#include "set.h"
+#include <stdio.h>
+
+#define RB_RED      (0ul)
+#define RB_BLACK    (1ul)
+
+struct rb_node {
+    uint64_t        key;
+    uint64_t        color;
+    struct rb_node* left;
+    struct rb_node* right;
+    struct rb_node* parent;
+};
+
+struct rbtree {
+    struct rb_node* root;
+};
+
+static inline struct rb_node*
+rb_left(struct rb_node* node, bool tx)
+{
+    return set_load(tx, &node->left);
+}
+
+static inline struct rb_node*
+rb_right(struct rb_node* node, bool tx)
+{
+    return set_load(tx, &node->right);
+}
+
+static inline struct rb_node*
+rb_parent(struct rb_node* node, bool tx)
+{
+    return set_load(tx, &node->parent);
+}
+
+/* NULL leaves are black. */
+static inline bool
+rb_is_red(struct rb_node* node, bool tx)
+{
+    return node && (set_load(tx, &node->color) == RB_RED);
+}
+
+/* Only stores changed colors, so that transactions don't
+ * conflict on unchanged nodes, such as the root. */
+static inline void
+rb_set_color(struct rb_node* node, uint64_t color, bool tx)
+{
+    if (set_load(tx, &node->color) != color) {
+        set_store(tx, &node->color, color);
+    }
+}
+
+/* Replaces the link to old in its parent, or the root, by node. */
+static inline void
+rb_replace_child(struct rbtree* tree, struct rb_node* parent,
+                 struct rb_node* old, struct rb_node* node, bool tx)
+{
+    if (!parent) {
+        set_store(tx, &tree->root, node);
+    } else if (rb_left(parent, tx) == old) {
+        set_store(tx, &parent->left, node);
+    } else {
+        set_store(tx, &parent->right, node);
+    }
+}
+
+static inline void
+rb_rotate_left(struct rbtree* tree, struct rb_node* x, bool tx)
+{
+    struct rb_node* y = rb_right(x, tx);
+    struct rb_node* beta = rb_left(y, tx);
+
+    set_store(tx, &x->right, beta);
+    if (beta) {
+        set_store(tx, &beta->parent, x);
+    }
+
+    struct rb_node* parent = rb_parent(x, tx);
+    set_store(tx, &y->parent, parent);
+    rb_replace_child(tree, parent, x, y, tx);
+
+    set_store(tx, &y->left, x);
+    set_store(tx, &x->parent, y);
+}
+
+static inline void
+rb_rotate_right(struct rbtree* tree, struct rb_node* x, bool tx)
+{
+    struct rb_node* y = rb_left(x, tx);
+    struct rb_node* beta = rb_right(y, tx);
+
+    set_store(tx, &x->left, beta);
+    if (beta) {
+        set_store(tx, &beta->parent, x);
+    }
+
+    struct rb_node* parent = rb_parent(x, tx);
+    set_store(tx, &y->parent, parent);
+    rb_replace_child(tree, parent, x, y, tx);
+
+    set_store(tx, &y->right, x);
+    set_store(tx, &x->parent, y);
+}
+
+static inline struct rb_node*
+rb_find(struct rbtree* tree, uint64_t key, bool tx)
+{
+    struct rb_node* node = set_load(tx, &tree->root);
+
+    while (node) {
+        uint64_t node_key = set_load(tx, &node->key);
+        if (key == node_key) {
+            break;
+        }
+        node = key < node_key ? rb_left(node, tx) : rb_right(node, tx);
+    }
+
+    return node;
+}
+
+static inline bool
+rbtree_contains(void* set, uint64_t key, bool tx)
+{
+    return !!rb_find(set, key, tx);
+}
+
+static inline void
+rb_insert_fixup(struct rbtree* tree, struct rb_node* z, bool tx)
+{
+    struct rb_node* p;
+
+    while ((p = rb_parent(z, tx)) && rb_is_red(p, tx)) {
+
+        /* A red parent is not the root. */
+        struct rb_node* g = rb_parent(p, tx);
+
+        if (p == rb_left(g, tx)) {
+            struct rb_node* u = rb_right(g, tx);
+            if (rb_is_red(u, tx)) {
+                rb_set_color(p, RB_BLACK, tx);
+                rb_set_color(u, RB_BLACK, tx);
+                rb_set_color(g, RB_RED, tx);
+                z = g;
+            } else {
+                if (z == rb_right(p, tx)) {
+                    z = p;
+                    rb_rotate_left(tree, z, tx);
+                    p = rb_parent(z, tx);
+                }
+                rb_set_color(p, RB_BLACK, tx);
+                rb_set_color(g, RB_RED, tx);
+                rb_rotate_right(tree, g, tx);
+            }
+        } else {
+            struct rb_node* u = rb_left(g, tx);
+            if (rb_is_red(u, tx)) {
+                rb_set_color(p, RB_BLACK, tx);
+                rb_set_color(u, RB_BLACK, tx);
+                rb_set_color(g, RB_RED, tx);
+                z = g;
+            } else {
+                if (z == rb_left(p, tx)) {
+                    z = p;
+                    rb_rotate_right(tree, z, tx);
+                    p = rb_parent(z, tx);
+                }
+                rb_set_color(p, RB_BLACK, tx);
+                rb_set_color(g, RB_RED, tx);
+                rb_rotate_left(tree, g, tx);
+            }
+        }
+    }
+
+    rb_set_color(set_load(tx, &tree->root), RB_BLACK, tx);
+}
+
+static inline bool
+rbtree_insert(void* set, uint64_t key, bool tx)
+{
+    struct rbtree* tree = set;
+
+    struct rb_node* parent = NULL;
+    struct rb_node* node = set_load(tx, &tree->root);
+    uint64_t parent_key = 0;
+
+    while (node) {
+        parent = node;
+        parent_key = set_load(tx, &node->key);
+        if (key == parent_key) {
+            return false;
+        }
+        node = key < parent_key ? rb_left(node, tx) : rb_right(node, tx);
+    }
+
+    /* The new node is private until we link it. */
+    struct rb_node* z = set_malloc(tx, sizeof(*z));
+    z->key = key;
+    z->color = RB_RED;
+    z->left = NULL;
+    z->right = NULL;
+    z->parent = parent;
+
+    if (!parent) {
+        set_store(tx, &tree->root, z);
+    } else if (key < parent_key) {
+        set_store(tx, &parent->left, z);
+    } else {
+        set_store(tx, &parent->right, z);
+    }
+
+    rb_insert_fixup(tree, z, tx);
+
+    return true;
+}
+
+/* Restores the tree's properties after removing a black node; x
+ * took its place below parent and might be NULL. */
+static inline void
+rb_remove_fixup(struct rbtree* tree, struct rb_node* x,
+                struct rb_node* parent, bool tx)
+{
+    while ((x != set_load(tx, &tree->root)) && !rb_is_red(x, tx)) {
+
+        /* x is doubly black, so its sibling w exists. */
+        if (x == rb_left(parent, tx)) {
+            struct rb_node* w = rb_right(parent, tx);
+            if (rb_is_red(w, tx)) {
+                rb_set_color(w, RB_BLACK, tx);
+                rb_set_color(parent, RB_RED, tx);
+                rb_rotate_left(tree, parent, tx);
+                w = rb_right(parent, tx);
+            }
+            if (!rb_is_red(rb_left(w, tx), tx) &&
+                !rb_is_red(rb_right(w, tx), tx)) {
+                rb_set_color(w, RB_RED, tx);
+                x = parent;
+                parent = rb_parent(x, tx);
+            } else {
+                if (!rb_is_red(rb_right(w, tx), tx)) {
+                    rb_set_color(rb_left(w, tx), RB_BLACK, tx);
+                    rb_set_color(w, RB_RED, tx);
+                    rb_rotate_right(tree, w, tx);
+                    w = rb_right(parent, tx);
+                }
+                rb_set_color(w, set_load(tx, &parent->color), tx);
+                rb_set_color(parent, RB_BLACK, tx);
+                rb_set_color(rb_right(w, tx), RB_BLACK, tx);
+                rb_rotate_left(tree, parent, tx);
+                break;
+            }
+        } else {
+            struct rb_node* w = rb_left(parent, tx);
+            if (rb_is_red(w, tx)) {
+                rb_set_color(w, RB_BLACK, tx);
+                rb_set_color(parent, RB_RED, tx);
+                rb_rotate_right(tree, parent, tx);
+                w = rb_left(parent, tx);
+            }
+            if (!rb_is_red(rb_right(w, tx), tx) &&
+                !rb_is_red(rb_left(w, tx), tx)) {
+                rb_set_color(w, RB_RED, tx);
+                x = parent;
+                parent = rb_parent(x, tx);
+            } else {
+                if (!rb_is_red(rb_left(w, tx), tx)) {
+                    rb_set_color(rb_right(w, tx), RB_BLACK, tx);
+                    rb_set_color(w, RB_RED, tx);
+                    rb_rotate_left(tree, w, tx);
+                    w = rb_left(parent, tx);
+                }
+                rb_set_color(w, set_load(tx, &parent->color), tx);
+                rb_set_color(parent, RB_BLACK, tx);
+                rb_set_color(rb_left(w, tx), RB_BLACK, tx);
+                rb_rotate_right(tree, parent, tx);
+                break;
+            }
+        }
+    }
+
+    if (rb_is_red(x, tx)) {
+        rb_set_color(x, RB_BLACK, tx);
+    }
+}
+
+static inline bool
+rbtree_remove(void* set, uint64_t key, bool tx)
+{
+    struct rbtree* tree = set;
+
+    struct rb_node* z = rb_find(tree, key, tx);
+    if (!z) {
+        return false;
+    }
+
+    /* y is the node we unlink: z itself, or z's successor if z
+     * has two children. */
+    struct rb_node* y = z;
+    struct rb_node* left = rb_left(z, tx);
+    struct rb_node* right = rb_right(z, tx);
+
+    if (left && right) {
+        y = right;
+        while ((left = rb_left(y, tx))) {
+            y = left;
+        }
+    }
+
+    struct rb_node* x = rb_left(y, tx);
+    if (!x) {
+        x = rb_right(y, tx);
+    }
+
+    struct rb_node* parent = rb_parent(y, tx);
+
+    if (x) {
+        set_store(tx, &x->parent, parent);
+    }
+    rb_replace_child(tree, parent, y, x, tx);
+
+    if (y != z) {
+        /* Keep z's place in the tree, but take y's key. */
+        set_store(tx, &z->key, set_load(tx, &y->key));
+    }
+
+    if (set_load(tx, &y->color) == RB_BLACK) {
+        rb_remove_fixup(tree, x, parent, tx);
+    }
+
+    set_free(tx, y);
+
+    return true;
+}
+
+SET_DEFINE_OPS(rbtree)
+
+static void*
+rbtree_create(uint64_t key_range)
+{
+    struct rbtree* tree = calloc(1, sizeof(*tree));
+    if (!tree) {
+        perror("calloc");
+        abort();
+    }
+
+    return tree;
+}
+
+static void
+rb_destroy_subtree(struct rb_node* node)
+{
+    while (node) {
+        rb_destroy_subtree(node->left);
+        struct rb_node* right = node->right;
+        set_free(false, node);
+        node = right;
+    }
+}
+
+static void
+rbtree_destroy(void* set)
+{
+    struct rbtree* tree = set;
+
+    rb_destroy_subtree(tree->root);
+    free(tree);
+}
+
+/* Returns the black height of the subtree, or -1 if it's broken, and
+ * adds its number of nodes to nkeys. */
+static long
+rb_verify_subtree(const struct rb_node* node, const struct rb_node* parent,
+                  const uint64_t* min, const uint64_t* max, long* nkeys)
+{
+    if (!node) {
+        return 1;
+    }
+
+    if ((node->parent != parent) ||
+        (min && (node->key <= *min)) ||
+        (max && (node->key >= *max))) {
+        return -1;
+    }
+
+    if ((node->color == RB_RED) &&
+        ((node->left && (node->left->color == RB_RED)) ||
+         (node->right && (node->right->color == RB_RED)))) {
+        return -1; /* Red node with red child */
+    }
+
+    long left = rb_verify_subtree(node->left, node, min, &node->key, nkeys);
+    long right = rb_verify_subtree(node->right, node, &node->key, max, nkeys);
+
+    if ((left < 0) || (left != right)) {
+        return -1;
+    }
+
+    ++*nkeys;
+
+    return left + (node->color == RB_BLACK);
+}
+
+static long
+rbtree_verify(void* set)
+{
+    const struct rbtree* tree = set;
+
+    if (tree->root && (tree->root->color != RB_BLACK)) {
+        return -1;
+    }
+
+    long nkeys = 0;
+
+    if (rb_verify_subtree(tree->root, NULL, NULL, NULL, &nkeys) < 0) {
+        return -1;
+    }
+
+    return nkeys;
+}
+
+const struct set_type g_set_rbtree = {
+    "rbtree",
+    rbtree_create,
+    rbtree_destroy,
+    rbtree_verify,
+    SET_OPS_TX(rbtree),
+    SET_OPS_PLAIN(rbtree)
+};
@@ -0,0 +1,210 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Skip list
+ *
+ * A node's level derives from a hash of its key, so operations need
+ * no random-number generator and retries pick the same level.
+ */
+
+#include "set.h"
+#include <stdio.h>
+
+#define SKIPLIST_MAX_LEVEL  (24)
+
+struct skiplist_node {
+    uint64_t              key;
+    uint64_t              level;
+    struct skiplist_node* next[];
+};
+
+struct skiplist {
+    /* The head's key is unused; it has all levels. */
+    struct skiplist_node* head;
+};
+
+/* Returns a level from 1 to SKIPLIST_MAX_LEVEL, where each level is
+ * half as likely as the one below. */
+static inline unsigned long
+skiplist_level(uint64_t key)
+{
+    uint64_t bits = set_mix(key) | (1ul << (SKIPLIST_MAX_LEVEL - 1));
+
+    return __builtin_ctzl(bits) + 1;
+}
+
+/* Stores the last node before key at each level in pred, and returns
+ * the node after pred[0]. */
+static inline struct skiplist_node*
+skiplist_find(struct skiplist* list, uint64_t key,
+              struct skiplist_node** pred, bool tx)
+{
+    struct skiplist_node* node = list->head;
+    struct skiplist_node* next = NULL;
+
+    long level;
+    for (level = SKIPLIST_MAX_LEVEL - 1; level >= 0; --level) {
+
+        next = set_load(tx, node->next + level);
+
+        while (next && (set_load(tx, &next->key) < key)) {
+            node = next;
+            next = set_load(tx, node->next + level);
+        }
+
+        pred[level] = node;
+    }
+
+    return next;
+}
+
+static inline bool
+skiplist_contains(void* set, uint64_t key, bool tx)
+{
+    struct skiplist_node* pred[SKIPLIST_MAX_LEVEL];
+    struct skiplist_node* node = skiplist_find(set, key, pred, tx);
+
+    return node && (set_load(tx, &node->key) == key);
+}
+
+static inline bool
+skiplist_insert(void* set, uint64_t key, bool tx)
+{
+    struct skiplist_node* pred[SKIPLIST_MAX_LEVEL];
+    struct skiplist_node* next = skiplist_find(set, key, pred, tx);
+
+    if (next && (set_load(tx, &next->key) == key)) {
+        return false;
+    }
+
+    unsigned long nlevels = skiplist_level(key);
+
+    struct skiplist_node* node =
+        set_malloc(tx, sizeof(*node) + nlevels * sizeof(node->next[0]));
+    node->key = key;
+    node->level = nlevels;
+
+    unsigned long level;
+    for (level = 0; level < nlevels; ++level) {
+        node->next[level] = set_load(tx, pred[level]->next + level);
+        set_store(tx, pred[level]->next + level, node);
+    }
+
+    return true;
+}
+
+static inline bool
+skiplist_remove(void* set, uint64_t key, bool tx)
+{
+    struct skiplist_node* pred[SKIPLIST_MAX_LEVEL];
+    struct skiplist_node* node = skiplist_find(set, key, pred, tx);
+
+    if (!node || (set_load(tx, &node->key) != key)) {
+        return false;
+    }
+
+    unsigned long nlevels = set_load(tx, &node->level);
+
+    unsigned long level;
+    for (level = 0; level < nlevels; ++level) {
+        set_store(tx, pred[level]->next + level,
+                  set_load(tx, node->next + level));
+    }
+
+    set_free(tx, node);
+
+    return true;
+}
+
+SET_DEFINE_OPS(skiplist)
+
+static void*
+skiplist_create(uint64_t key_range)
+{
+    struct skiplist* list = calloc(1, sizeof(*list));
+    if (!list) {
+        perror("calloc");
+        abort();
+    }
+
+    list->head = calloc(1, sizeof(*list->head) +
+                           SKIPLIST_MAX_LEVEL * sizeof(list->head->next[0]));
+    if (!list->head) {
+        perror("calloc");
+        abort();
+    }
+    list->head->level = SKIPLIST_MAX_LEVEL;
+
+    return list;
+}
+
+static void
+skiplist_destroy(void* set)
+{
+    struct skiplist* list = set;
+    struct skiplist_node* node = list->head->next[0];
+
+    while (node) {
+        struct skiplist_node* next = node->next[0];
+        set_free(false, node);
+        node = next;
+    }
+
+    free(list->head);
+    free(list);
+}
+
+static long
+skiplist_verify(void* set)
+{
+    const struct skiplist* list = set;
+
+    long nkeys = 0;
+
+    const struct skiplist_node* node = list->head->next[0];
+    for (; node; node = node->next[0], ++nkeys) {
+        if (node->level != skiplist_level(node->key)) {
+            return -1;
+        }
+        if (node->next[0] && (node->next[0]->key <= node->key)) {
+            return -1; /* Not sorted */
+        }
+    }
+
+    /* Each upper level is a subsequence of the one below. */
+    unsigned long level;
+    for (level = 1; level < SKIPLIST_MAX_LEVEL; ++level) {
+
+        const struct skiplist_node* lower = list->head->next[level - 1];
+        const struct skiplist_node* upper = list->head->next[level];
+
+        for (; upper; upper = upper->next[level]) {
+            while (lower && (lower != upper)) {
+                lower = lower->next[level - 1];
+            }
+            if (!lower || (upper->level <= level)) {
+                return -1;
+            }
+        }
+    }
+
+    return nkeys;
+}
+
+const struct set_type g_set_skiplist = {
+    "skiplist",
+    skiplist_create,
+    skiplist_destroy,
+    skiplist_verify,
+    SET_OPS_TX(skiplist),
+    SET_OPS_PLAIN(skiplist)
+};
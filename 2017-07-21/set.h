@@ -0,0 +1,174 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+#include "stdlib-tx.h"
+#include "tm-access.h"
+
+/*
+ * Integer sets for bench-set
+ *
+ * Each set type implements its operations once, with a flag that
+ * selects transactional or plain accesses, and instantiates both
+ * variants with SET_DEFINE_OPS(). Transactional variants must run
+ * within a transaction; plain variants under a lock. All fields that
+ * operations access must be 8 bytes large, such as keys, pointers
+ * and uint64_t. Nodes come from the slab allocator in either
+ * variant; free them with set_free().
+ */
+
+static inline uint64_t
+_set_load64(bool tx, const void* addr)
+{
+    if (tx) {
+        return tm_load_u64(addr);
+    }
+
+    uint64_t value;
+    memcpy(&value, addr, sizeof(value));
+
+    return value;
+}
+
+static inline void
+_set_store64(bool tx, void* addr, uint64_t value)
+{
+    if (tx) {
+        tm_store_u64(addr, value);
+    } else {
+        memcpy(addr, &value, sizeof(value));
+    }
+}
+
+/* Loads the field at _addr. */
+#define set_load(_tx, _addr)                                            \
+    ((__typeof__(*(_addr)))(uintptr_t)_set_load64((_tx), (_addr)))
+
+/* Stores _value to the field at _addr. */
+#define set_store(_tx, _addr, _value)                                   \
+    _set_store64((_tx), (_addr), (uint64_t)(uintptr_t)(_value))
+
+static inline void*
+set_malloc(bool tx, size_t size)
+{
+    if (tx) {
+        return malloc_tx(size);
+    }
+
+    void* ptr = slab_alloc(size);
+    if (!ptr) {
+        abort(); /* Out of memory; let's abort for now. */
+    }
+
+    return ptr;
+}
+
+static inline void
+set_free(bool tx, void* ptr)
+{
+    if (tx) {
+        free_tx(ptr);
+    } else {
+        slab_free(ptr);
+    }
+}
+
+/**
+ * Mixes the bits of a key, e.g., for hashing.
+ */
+static inline uint64_t
+set_mix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdul;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ul;
+    key ^= key >> 33;
+
+    return key;
+}
+
+/**
+ * Operations on a set; each returns true if the key was found,
+ * inserted or removed.
+ */
+struct set_ops {
+    bool (*contains)(void* set, uint64_t key);
+    bool (*insert)(void* set, uint64_t key);
+    bool (*remove)(void* set, uint64_t key);
+};
+
+/**
+ * A set type
+ */
+struct set_type {
+    const char* name;
+    /* Creates an empty set for keys below key_range. */
+    void* (*create)(uint64_t key_range);
+    void  (*destroy)(void* set);
+    /* Checks the set's invariants and returns its number of keys,
+     * or -1 if the set is broken. Not thread-safe. */
+    long  (*verify)(void* set);
+    struct set_ops tx;
+    struct set_ops plain;
+};
+
+/* Defines _prefix_ops_tx and _prefix_ops_plain from the functions
+ * _prefix_contains(), _prefix_insert() and _prefix_remove(), which
+ * take the flag as their last argument. */
+#define SET_DEFINE_OPS(_prefix)                                         \
+    static bool                                                         \
+    _prefix##_contains_tx(void* set, uint64_t key)                      \
+    {                                                                   \
+        return _prefix##_contains(set, key, true);                      \
+    }                                                                   \
+    static bool                                                         \
+    _prefix##_insert_tx(void* set, uint64_t key)                        \
+    {                                                                   \
+        return _prefix##_insert(set, key, true);                        \
+    }                                                                   \
+    static bool                                                         \
+    _prefix##_remove_tx(void* set, uint64_t key)                        \
+    {                                                                   \
+        return _prefix##_remove(set, key, true);                        \
+    }                                                                   \
+    static bool                                                         \
+    _prefix##_contains_plain(void* set, uint64_t key)                   \
+    {                                                                   \
+        return _prefix##_contains(set, key, false);                     \
+    }                                                                   \
+    static bool                                                         \
+    _prefix##_insert_plain(void* set, uint64_t key)                     \
+    {                                                                   \
+        return _prefix##_insert(set, key, false);                       \
+    }                                                                   \
+    static bool                                                         \
+    _prefix##_remove_plain(void* set, uint64_t key)                     \
+    {                                                                   \
+        return _prefix##_remove(set, key, false);                       \
+    }
+
+#define SET_OPS_TX(_prefix)                                             \
+    {_prefix##_contains_tx, _prefix##_insert_tx, _prefix##_remove_tx}
+
+#define SET_OPS_PLAIN(_prefix)                                          \
+    {_prefix##_contains_plain, _prefix##_insert_plain, _prefix##_remove_plain}
+
+extern const struct set_type g_set_hash;
+extern const struct set_type g_set_list;
+extern const struct set_type g_set_rbtree;
+extern const struct set_type g_set_skiplist;
@@ -0,0 +1,320 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "slab.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Size of a newly allocated slab */
+#define SLAB_NBYTES         (1ul << 16)
+
+/* Number of blocks that move between a thread cache and the depot */
+#define SLAB_BATCH_NBLOCKS  (32)
+
+/* Size class of blocks from malloc() */
+#define SLAB_CLASS_MALLOC   (SLAB_NCLASSES)
+
+/**
+ * Header in front of each block; keeps blocks 16-byte aligned.
+ */
+struct slab_header {
+    unsigned long sclass;
+    unsigned long reserved;
+};
+
+/**
+ * A free block. The first block of a batch in the depot links to
+ * the next batch.
+ */
+struct slab_free {
+    struct slab_free* next;
+    struct slab_free* next_batch;
+};
+
+/**
+ * A thread's free blocks of a size class
+ */
+struct slab_cache {
+    struct slab_free* head;
+    unsigned long     nblocks;
+};
+
+/* Batches of free blocks, per size class */
+static struct slab_free* g_slab_depot[SLAB_NCLASSES];
+static pthread_mutex_t   g_slab_depot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t g_slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  g_slab_key;
+
+static __thread struct slab_cache t_slab_cache[SLAB_NCLASSES];
+static __thread bool              t_slab_registered;
+
+static void
+lock_depot(void)
+{
+    int err = pthread_mutex_lock(&g_slab_depot_lock);
+    if (err) {
+        errno = err;
+        perror("pthread_mutex_lock");
+        abort();
+    }
+}
+
+static void
+unlock_depot(void)
+{
+    int err = pthread_mutex_unlock(&g_slab_depot_lock);
+    if (err) {
+        errno = err;
+        perror("pthread_mutex_unlock");
+        abort();
+    }
+}
+
+static unsigned long
+size_class(size_t size)
+{
+    unsigned long sclass = 0;
+
+    while ((sclass < SLAB_NCLASSES) &&
+           ((1ul << (SLAB_MIN_NBYTES_BITSHIFT + sclass)) < size)) {
+        ++sclass;
+    }
+
+    return sclass;
+}
+
+static size_t
+class_nbytes(unsigned long sclass)
+{
+    return 1ul << (SLAB_MIN_NBYTES_BITSHIFT + sclass);
+}
+
+static void*
+block_of_header(struct slab_header* header)
+{
+    return header + 1;
+}
+
+static struct slab_header*
+header_of_block(void* ptr)
+{
+    return (struct slab_header*)ptr - 1;
+}
+
+/*
+ * Depot
+ */
+
+/* Moves up to nblocks blocks from the cache to the depot, in
+ * batches of at most SLAB_BATCH_NBLOCKS blocks. */
+static void
+flush_cache(struct slab_cache* cache, unsigned long sclass,
+            unsigned long nblocks)
+{
+    while (cache->nblocks && nblocks) {
+
+        struct slab_free* batch = cache->head;
+        struct slab_free* last = batch;
+        unsigned long n = 1;
+
+        while ((n < nblocks) && (n < cache->nblocks) &&
+               (n < SLAB_BATCH_NBLOCKS)) {
+            last = last->next;
+            ++n;
+        }
+
+        cache->head = last->next;
+        cache->nblocks -= n;
+        nblocks -= n;
+
+        last->next = NULL;
+
+        lock_depot();
+        batch->next_batch = g_slab_depot[sclass];
+        g_slab_depot[sclass] = batch;
+        unlock_depot();
+    }
+}
+
+/* Moves a batch from the depot to the empty cache. Returns false if
+ * the depot has no batches. */
+static bool
+refill_cache_from_depot(struct slab_cache* cache, unsigned long sclass)
+{
+    lock_depot();
+    struct slab_free* batch = g_slab_depot[sclass];
+    if (batch) {
+        g_slab_depot[sclass] = batch->next_batch;
+    }
+    unlock_depot();
+
+    if (!batch) {
+        return false;
+    }
+
+    unsigned long n = 0;
+    struct slab_free* block;
+
+    for (block = batch; block; block = block->next) {
+        ++n;
+    }
+
+    cache->head = batch;
+    cache->nblocks = n;
+
+    return true;
+}
+
+/* Splits a new slab into blocks for the empty cache. */
+static bool
+refill_cache_from_slab(struct slab_cache* cache, unsigned long sclass)
+{
+    size_t block_nbytes = sizeof(struct slab_header) + class_nbytes(sclass);
+
+    uint8_t* slab = malloc(SLAB_NBYTES);
+    if (!slab) {
+        return false;
+    }
+
+    uint8_t* beg = slab;
+    uint8_t* end = slab + SLAB_NBYTES - block_nbytes;
+
+    for (; beg <= end; beg += block_nbytes) {
+
+        struct slab_header* header = (struct slab_header*)beg;
+        header->sclass = sclass;
+
+        struct slab_free* block = block_of_header(header);
+        block->next = cache->head;
+        cache->head = block;
+        ++cache->nblocks;
+    }
+
+    return true;
+}
+
+/* Returns the thread's free blocks to the depot on thread exit. */
+static void
+flush_thread_cache(void* data)
+{
+    struct slab_cache* cache = data;
+
+    unsigned long sclass;
+    for (sclass = 0; sclass < SLAB_NCLASSES; ++sclass) {
+        flush_cache(cache + sclass, sclass, cache[sclass].nblocks);
+    }
+}
+
+static void
+init_slab_key(void)
+{
+    int err = pthread_key_create(&g_slab_key, flush_thread_cache);
+    if (err) {
+        errno = err;
+        perror("pthread_key_create");
+        abort();
+    }
+}
+
+static void
+register_thread_cache(void)
+{
+    int err = pthread_once(&g_slab_once, init_slab_key);
+    if (err) {
+        errno = err;
+        perror("pthread_once");
+        abort();
+    }
+
+    err = pthread_setspecific(g_slab_key, t_slab_cache);
+    if (err) {
+        errno = err;
+        perror("pthread_setspecific");
+        abort();
+    }
+
+    t_slab_registered = true;
+}
+
+/*
+ * Public interface
+ */
+
+void*
+slab_alloc(size_t size)
+{
+    unsigned long sclass = size_class(size);
+
+    if (sclass == SLAB_CLASS_MALLOC) {
+        struct slab_header* header = malloc(sizeof(*header) + size);
+        if (!header) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        header->sclass = SLAB_CLASS_MALLOC;
+        return block_of_header(header);
+    }
+
+    if (__builtin_expect(!t_slab_registered, 0)) {
+        register_thread_cache();
+    }
+
+    struct slab_cache* cache = t_slab_cache + sclass;
+
+    if (!cache->head &&
+        !refill_cache_from_depot(cache, sclass) &&
+        !refill_cache_from_slab(cache, sclass)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct slab_free* block = cache->head;
+    cache->head = block->next;
+    --cache->nblocks;
+
+    return block;
+}
+
+void
+slab_free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    struct slab_header* header = header_of_block(ptr);
+
+    if (header->sclass == SLAB_CLASS_MALLOC) {
+        free(header);
+        return;
+    }
+
+    if (__builtin_expect(!t_slab_registered, 0)) {
+        register_thread_cache();
+    }
+
+    struct slab_cache* cache = t_slab_cache + header->sclass;
+
+    struct slab_free* block = ptr;
+    block->next = cache->head;
+    cache->head = block;
+    ++cache->nblocks;
+
+    /* Keep at most two batches; hand one to other threads. */
+    if (cache->nblocks > 2 * SLAB_BATCH_NBLOCKS) {
+        flush_cache(cache, header->sclass, SLAB_BATCH_NBLOCKS);
+    }
+}
@@ -0,0 +1,43 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Slab allocator
+ *
+ * Blocks of up to SLAB_MAX_NBYTES come from per-thread caches with
+ * one free list per size class. Threads exchange batches of free
+ * blocks through a global depot, so blocks freed by other threads
+ * find their way back. Larger blocks come from malloc(). Slabs are
+ * never returned to the system.
+ */
+
+#define SLAB_MIN_NBYTES_BITSHIFT    (4)
+#define SLAB_NCLASSES               (8)
+#define SLAB_MAX_NBYTES             (1ul << (SLAB_MIN_NBYTES_BITSHIFT + \
+                                             SLAB_NCLASSES - 1))
+
+/**
+ * Returns a block of at least size bytes, aligned to 16 bytes, or
+ * NULL with errno set to ENOMEM.
+ */
+void*
+slab_alloc(size_t size);
+
+/**
+ * Frees a block returned by slab_alloc(); possibly from another
+ * thread.
+ */
+void
+slab_free(void* ptr);
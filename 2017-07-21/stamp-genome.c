@@ -0,0 +1,374 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Gene sequencing
+ *
+ * Threads reconstruct a gene from overlapping segments. First they
+ * remove duplicate segments with a transactional hash set. Then, for
+ * decreasing overlap lengths, they link each segment whose suffix
+ * matches the prefix of another segment. Transactions walk hash
+ * chains and update the segment chains on both ends.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+#include "stamp.h"
+
+#define GENOME_LENGTH           (16384)
+#define GENOME_SEGMENT_LENGTH   (64)
+/* Segments start at least every GENOME_STRIDE bases, so the minimum
+ * overlap is GENOME_SEGMENT_LENGTH - GENOME_STRIDE. */
+#define GENOME_STRIDE           (32)
+/* Additional segments at random positions, in percent of the
+ * gene's length */
+#define GENOME_RANDOM_PERCENT   (25)
+
+/* Segment indices are stored plus 1; 0 is none. */
+#define NONE                    (0)
+
+struct genome_node {
+    uint64_t            segment;
+    struct genome_node* next;
+};
+
+struct genome {
+    unsigned long        nthreads;
+    unsigned long        length;
+    char*                gene;
+    unsigned long        nsegments;
+    char*                segment;
+    /* Power of two */
+    unsigned long        nbuckets;
+    /* Transactional hash set of unique segments */
+    struct genome_node** unique_bucket;
+    uint64_t*            unique;
+    uint64_t             nunique;
+    /* Prefixes of unlinked segments of the current overlap length */
+    uint64_t*            prefix_bucket;
+    uint64_t*            prefix_next;
+    /* Segment chains; end is valid at heads, head at tails. */
+    uint64_t*            next;
+    uint64_t*            prev;
+    uint64_t*            head;
+    uint64_t*            end;
+    uint64_t*            overlap;
+    /* The reconstructed gene */
+    char*                result;
+    pthread_barrier_t    barrier;
+};
+
+static void*
+genome_setup(const struct stamp_config* config)
+{
+    struct genome* g = bench_calloc(1, sizeof(*g));
+
+    g->nthreads = config->nthreads;
+    g->length = GENOME_LENGTH * config->scale;
+    g->gene = bench_calloc(g->length + 1, 1);
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, config->seed);
+
+    unsigned long i;
+    for (i = 0; i < g->length; ++i) {
+        g->gene[i] = "ACGT"[bench_rand_below(&rand, 4)];
+    }
+
+    /* Segments at every stride, one at the end, and some at
+     * random positions, in random order */
+    unsigned long nstrided = (g->length - GENOME_SEGMENT_LENGTH) / GENOME_STRIDE + 1;
+    unsigned long nrandom = g->length * GENOME_RANDOM_PERCENT / 100;
+
+    g->nsegments = nstrided + 1 + nrandom;
+    g->segment = bench_calloc(g->nsegments, GENOME_SEGMENT_LENGTH);
+
+    for (i = 0; i < g->nsegments; ++i) {
+        unsigned long pos;
+        if (i < nstrided) {
+            pos = i * GENOME_STRIDE;
+        } else if (i == nstrided) {
+            pos = g->length - GENOME_SEGMENT_LENGTH;
+        } else {
+            pos = bench_rand_below(&rand, g->length - GENOME_SEGMENT_LENGTH + 1);
+        }
+        memcpy(g->segment + i * GENOME_SEGMENT_LENGTH, g->gene + pos,
+               GENOME_SEGMENT_LENGTH);
+    }
+
+    for (i = g->nsegments - 1; i > 0; --i) {
+        unsigned long j = bench_rand_below(&rand, i + 1);
+        char tmp[GENOME_SEGMENT_LENGTH];
+        memcpy(tmp, g->segment + i * GENOME_SEGMENT_LENGTH, GENOME_SEGMENT_LENGTH);
+        memcpy(g->segment + i * GENOME_SEGMENT_LENGTH,
+               g->segment + j * GENOME_SEGMENT_LENGTH, GENOME_SEGMENT_LENGTH);
+        memcpy(g->segment + j * GENOME_SEGMENT_LENGTH, tmp, GENOME_SEGMENT_LENGTH);
+    }
+
+    g->nbuckets = 1;
+    while (g->nbuckets < 2 * g->nsegments) {
+        g->nbuckets <<= 1;
+    }
+
+    g->unique_bucket = bench_calloc(g->nbuckets, sizeof(*g->unique_bucket));
+    g->unique = bench_calloc(g->nsegments, sizeof(*g->unique));
+    g->prefix_bucket = bench_calloc(g->nbuckets, sizeof(*g->prefix_bucket));
+    g->prefix_next = bench_calloc(g->nsegments, sizeof(*g->prefix_next));
+    g->next = bench_calloc(g->nsegments, sizeof(*g->next));
+    g->prev = bench_calloc(g->nsegments, sizeof(*g->prev));
+    g->head = bench_calloc(g->nsegments, sizeof(*g->head));
+    g->end = bench_calloc(g->nsegments, sizeof(*g->end));
+    g->overlap = bench_calloc(g->nsegments, sizeof(*g->overlap));
+
+    /* Each segment starts as a chain of its own. */
+    for (i = 0; i < g->nsegments; ++i) {
+        g->head[i] = i + 1;
+        g->end[i] = i + 1;
+    }
+
+    int err = pthread_barrier_init(&g->barrier, NULL, g->nthreads);
+    if (err) {
+        perror("pthread_barrier_init");
+        abort();
+    }
+
+    return g;
+}
+
+static uint64_t
+hash_bases(const char* bases, unsigned long n)
+{
+    uint64_t hash = 0xcbf29ce484222325ul; /* FNV-1a */
+
+    unsigned long i;
+    for (i = 0; i < n; ++i) {
+        hash = (hash ^ (uint8_t)bases[i]) * 0x100000001b3ul;
+    }
+
+    return hash;
+}
+
+static const char*
+segment_bases(const struct genome* g, uint64_t segment)
+{
+    return g->segment + segment * GENOME_SEGMENT_LENGTH;
+}
+
+/* Inserts a segment into the set of unique segments. */
+static void
+insert_unique(struct genome* g, uint64_t segment, struct genome_node** bucket)
+{
+    const char* bases = segment_bases(g, segment);
+
+    tm_begin
+        struct genome_node* node = tm_load_ptr((void* const*)bucket);
+
+        /* Segments never change; compare them directly. */
+        while (node && memcmp(segment_bases(g, tm_load_u64(&node->segment)),
+                              bases, GENOME_SEGMENT_LENGTH)) {
+            node = tm_load_ptr((void* const*)&node->next);
+        }
+
+        if (!node) {
+            node = malloc_tx(sizeof(*node));
+            node->segment = segment;
+            node->next = tm_load_ptr((void* const*)bucket);
+            tm_store_ptr((void**)bucket, node);
+
+            uint64_t n = tm_load_u64(&g->nunique);
+            tm_store_u64(g->unique + n, segment);
+            tm_store_u64(&g->nunique, n + 1);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+/* Adds an unlinked segment to the prefix table of the current
+ * overlap; the caller hashes the prefix. */
+static void
+insert_prefix(struct genome* g, uint64_t segment, uint64_t* bucket)
+{
+    tm_begin
+        if (tm_load_u64(g->prev + segment) == NONE) {
+            tm_store_u64(g->prefix_next + segment, tm_load_u64(bucket));
+            tm_store_u64(bucket, segment + 1);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+/* Links a segment to a successor with an overlap of k bases; the
+ * caller hashes the suffix. */
+static void
+link_segment(struct genome* g, uint64_t segment, unsigned long k, uint64_t* bucket)
+{
+    const char* suffix = segment_bases(g, segment) + GENOME_SEGMENT_LENGTH - k;
+
+    tm_begin
+        if (tm_load_u64(g->next + segment) == NONE) {
+
+            uint64_t head = tm_load_u64(g->head + segment);
+            uint64_t candidate = tm_load_u64(bucket);
+
+            while (candidate != NONE) {
+
+                uint64_t other = candidate - 1;
+
+                /* Linking to our own chain's head would close
+                 * a cycle. */
+                if ((candidate != head) &&
+                    (tm_load_u64(g->prev + other) == NONE) &&
+                    !memcmp(segment_bases(g, other), suffix, k)) {
+
+                    uint64_t end = tm_load_u64(g->end + other);
+
+                    tm_store_u64(g->next + segment, candidate);
+                    tm_store_u64(g->prev + other, segment + 1);
+                    tm_store_u64(g->overlap + segment, k);
+                    tm_store_u64(g->end + head - 1, end);
+                    tm_store_u64(g->head + end - 1, head);
+                    break;
+                }
+
+                candidate = tm_load_u64(g->prefix_next + other);
+            }
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+/* Concatenates the chain that starts at the first unlinked segment;
+ * runs in a single thread. */
+static void
+build_result(struct genome* g)
+{
+    uint64_t segment = NONE;
+
+    unsigned long i;
+    for (i = 0; i < g->nunique; ++i) {
+        if (g->prev[g->unique[i]] == NONE) {
+            segment = g->unique[i] + 1;
+            break;
+        }
+    }
+
+    unsigned long length = 0;
+    unsigned long overlap = 0;
+
+    g->result = bench_calloc(g->nunique * GENOME_SEGMENT_LENGTH + 1, 1);
+
+    while (segment != NONE) {
+        memcpy(g->result + length, segment_bases(g, segment - 1) + overlap,
+               GENOME_SEGMENT_LENGTH - overlap);
+        length += GENOME_SEGMENT_LENGTH - overlap;
+        overlap = g->overlap[segment - 1];
+        segment = g->next[segment - 1];
+    }
+}
+
+static void
+genome_run(void* state, unsigned long index)
+{
+    struct genome* g = state;
+
+    unsigned long beg, end, i;
+    stamp_partition(g->nsegments, g->nthreads, index, &beg, &end);
+
+    for (i = beg; i < end; ++i) {
+        uint64_t hash = hash_bases(segment_bases(g, i), GENOME_SEGMENT_LENGTH);
+        insert_unique(g, i, g->unique_bucket + (hash & (g->nbuckets - 1)));
+    }
+
+    bench_barrier_wait(&g->barrier);
+
+    stamp_partition(g->nunique, g->nthreads, index, &beg, &end);
+
+    unsigned long k;
+    for (k = GENOME_SEGMENT_LENGTH - 1;
+         k >= GENOME_SEGMENT_LENGTH - GENOME_STRIDE; --k) {
+
+        for (i = beg; i < end; ++i) {
+            uint64_t segment = g->unique[i];
+            uint64_t hash = hash_bases(segment_bases(g, segment), k);
+            insert_prefix(g, segment, g->prefix_bucket + (hash & (g->nbuckets - 1)));
+        }
+
+        bench_barrier_wait(&g->barrier);
+
+        for (i = beg; i < end; ++i) {
+            uint64_t segment = g->unique[i];
+            uint64_t hash = hash_bases(segment_bases(g, segment) +
+                                       GENOME_SEGMENT_LENGTH - k, k);
+            link_segment(g, segment, k, g->prefix_bucket + (hash & (g->nbuckets - 1)));
+        }
+
+        if (bench_barrier_wait(&g->barrier)) {
+            memset(g->prefix_bucket, 0, g->nbuckets * sizeof(*g->prefix_bucket));
+        }
+        bench_barrier_wait(&g->barrier);
+    }
+
+    if (!index) {
+        build_result(g);
+    }
+}
+
+static bool
+genome_verify(void* state)
+{
+    struct genome* g = state;
+
+    return !strcmp(g->result, g->gene);
+}
+
+static void
+genome_teardown(void* state)
+{
+    struct genome* g = state;
+
+    unsigned long i;
+    for (i = 0; i < g->nbuckets; ++i) {
+        struct genome_node* node = g->unique_bucket[i];
+        while (node) {
+            struct genome_node* next = node->next;
+            slab_free(node);
+            node = next;
+        }
+    }
+
+    pthread_barrier_destroy(&g->barrier);
+    free(g->result);
+    free(g->overlap);
+    free(g->end);
+    free(g->head);
+    free(g->prev);
+    free(g->next);
+    free(g->prefix_next);
+    free(g->prefix_bucket);
+    free(g->unique);
+    free(g->unique_bucket);
+    free(g->segment);
+    free(g->gene);
+    free(g);
+}
+
+const struct stamp_app g_stamp_genome = {
+    "genome",
+    genome_setup,
+    genome_run,
+    genome_verify,
+    genome_teardown
+};
@@ -0,0 +1,327 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Network intrusion detection
+ *
+ * Threads take packets from a shared queue and add them to the
+ * reassembly map of their flow. The thread that adds a flow's last
+ * fragment removes the flow from the map, reassembles its payload
+ * and scans it for attack signatures. Packets arrive in random order,
+ * so threads often update the same flows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stamp.h"
+
+#define INTRUDER_NFLOWS             (4096)
+#define INTRUDER_MAX_NFRAGMENTS     (8)
+#define INTRUDER_MAX_LENGTH         (256)
+#define INTRUDER_ATTACK_PERCENT     (10)
+
+/* Random payloads are lower-case letters, so they never contain
+ * a signature. */
+static const char* const g_signature[] = {
+    "<script>",
+    "DROP TABLE",
+    "../../",
+    "%00"
+};
+
+#define INTRUDER_NSIGNATURES \
+    (sizeof(g_signature) / sizeof(g_signature[0]))
+
+struct intruder_packet {
+    uint64_t flow;
+    uint64_t fragment;
+    uint64_t nfragments;
+    uint64_t length;
+    char     data[];
+};
+
+/* A flow in reassembly */
+struct intruder_flow {
+    uint64_t                      id;
+    uint64_t                      nfragments;
+    uint64_t                      nreceived;
+    struct intruder_flow*         next;
+    const struct intruder_packet* fragment[];
+};
+
+struct intruder {
+    unsigned long            nflows;
+    unsigned long            npackets;
+    struct intruder_packet** packet;
+    bool*                    is_attack;
+    /* Updated in transactions */
+    uint64_t                 next_packet;
+    unsigned long            nbuckets;
+    struct intruder_flow**   bucket;
+    uint64_t*                detected;
+    uint64_t                 ncompleted;
+};
+
+static void*
+intruder_setup(const struct stamp_config* config)
+{
+    struct intruder* in = bench_calloc(1, sizeof(*in));
+
+    unsigned long nflows = INTRUDER_NFLOWS * config->scale;
+
+    in->nflows = nflows;
+    in->is_attack = bench_calloc(nflows, sizeof(*in->is_attack));
+    in->detected = bench_calloc(nflows, sizeof(*in->detected));
+    in->packet = bench_calloc(nflows * INTRUDER_MAX_NFRAGMENTS,
+                              sizeof(*in->packet));
+
+    in->nbuckets = 1;
+    while (in->nbuckets < nflows) {
+        in->nbuckets <<= 1;
+    }
+    in->bucket = bench_calloc(in->nbuckets, sizeof(*in->bucket));
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, config->seed);
+
+    unsigned long flow;
+    for (flow = 0; flow < nflows; ++flow) {
+
+        char payload[INTRUDER_MAX_LENGTH];
+        unsigned long length = INTRUDER_MAX_LENGTH / 4 +
+            bench_rand_below(&rand, INTRUDER_MAX_LENGTH * 3 / 4);
+
+        unsigned long i;
+        for (i = 0; i < length; ++i) {
+            payload[i] = 'a' + bench_rand_below(&rand, 26);
+        }
+
+        if (bench_rand_below(&rand, 100) < INTRUDER_ATTACK_PERCENT) {
+            const char* sig = g_signature[bench_rand_below(&rand, INTRUDER_NSIGNATURES)];
+            size_t len = strlen(sig);
+            memcpy(payload + bench_rand_below(&rand, length - len + 1), sig, len);
+            in->is_attack[flow] = true;
+        }
+
+        /* Split the payload into fragments. */
+        unsigned long nfragments = 1 + bench_rand_below(&rand, INTRUDER_MAX_NFRAGMENTS);
+        unsigned long fragment;
+        for (fragment = 0; fragment < nfragments; ++fragment) {
+
+            unsigned long beg = length * fragment / nfragments;
+            unsigned long end = length * (fragment + 1) / nfragments;
+
+            struct intruder_packet* packet =
+                bench_calloc(1, sizeof(*packet) + end - beg);
+            packet->flow = flow;
+            packet->fragment = fragment;
+            packet->nfragments = nfragments;
+            packet->length = end - beg;
+            memcpy(packet->data, payload + beg, end - beg);
+
+            in->packet[in->npackets++] = packet;
+        }
+    }
+
+    /* Packets arrive in random order. */
+    unsigned long i;
+    for (i = in->npackets - 1; i > 0; --i) {
+        unsigned long j = bench_rand_below(&rand, i + 1);
+        struct intruder_packet* tmp = in->packet[i];
+        in->packet[i] = in->packet[j];
+        in->packet[j] = tmp;
+    }
+
+    return in;
+}
+
+/* Adds a packet to its flow. If the flow is complete, stores its
+ * fragments and returns their number; otherwise returns 0. */
+static unsigned long
+add_packet(struct intruder* in, const struct intruder_packet* packet,
+           const struct intruder_packet** fragment)
+{
+    struct intruder_flow** bucket = in->bucket +
+        ((packet->flow * 0x9e3779b97f4a7c15ul >> 32) & (in->nbuckets - 1));
+
+    tm_save unsigned long nfragments = 0;
+
+    tm_begin
+        nfragments = 0;
+
+        struct intruder_flow** link = bucket;
+        struct intruder_flow* flow = tm_load_ptr((void* const*)link);
+
+        while (flow && (tm_load_u64(&flow->id) != packet->flow)) {
+            link = &flow->next;
+            flow = tm_load_ptr((void* const*)link);
+        }
+
+        if (!flow) {
+            /* The new flow is private until we link it. */
+            flow = malloc_tx(sizeof(*flow) +
+                             packet->nfragments * sizeof(flow->fragment[0]));
+            flow->id = packet->flow;
+            flow->nfragments = packet->nfragments;
+            flow->nreceived = 0;
+            flow->next = tm_load_ptr((void* const*)bucket);
+            memset(flow->fragment, 0, packet->nfragments * sizeof(flow->fragment[0]));
+
+            tm_store_ptr((void**)bucket, flow);
+            link = bucket;
+        }
+
+        tm_store_ptr((void**)(flow->fragment + packet->fragment), (void*)packet);
+
+        uint64_t nreceived = tm_load_u64(&flow->nreceived) + 1;
+
+        if (nreceived < packet->nfragments) {
+            tm_store_u64(&flow->nreceived, nreceived);
+        } else {
+            /* Complete; take the flow out of the map. */
+            unsigned long i;
+            for (i = 0; i < packet->nfragments; ++i) {
+                fragment[i] = tm_load_ptr((void* const*)(flow->fragment + i));
+            }
+            tm_store_ptr((void**)link, tm_load_ptr((void* const*)&flow->next));
+            free_tx(flow);
+
+            nfragments = packet->nfragments;
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+
+    return nfragments;
+}
+
+static bool
+is_attack(const char* payload, size_t length)
+{
+    size_t i, pos;
+    for (i = 0; i < INTRUDER_NSIGNATURES; ++i) {
+        size_t len = strlen(g_signature[i]);
+        for (pos = 0; pos + len <= length; ++pos) {
+            if (!memcmp(payload + pos, g_signature[i], len)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void
+intruder_run(void* state, unsigned long index)
+{
+    struct intruder* in = state;
+
+    const struct intruder_packet* fragment[INTRUDER_MAX_NFRAGMENTS];
+    char payload[INTRUDER_MAX_LENGTH];
+
+    while (true) {
+
+        tm_save uint64_t p = 0;
+
+        tm_begin
+            p = tm_load_u64(&in->next_packet);
+            if (p < in->npackets) {
+                tm_store_u64(&in->next_packet, p + 1);
+            }
+        tm_commit
+            tm_restart();
+        tm_end
+
+        if (p >= in->npackets) {
+            break;
+        }
+
+        const struct intruder_packet* packet = in->packet[p];
+
+        unsigned long nfragments = add_packet(in, packet, fragment);
+        if (!nfragments) {
+            continue;
+        }
+
+        /* Reassemble and scan the payload. */
+        size_t length = 0;
+
+        unsigned long i;
+        for (i = 0; i < nfragments; ++i) {
+            memcpy(payload + length, fragment[i]->data, fragment[i]->length);
+            length += fragment[i]->length;
+        }
+
+        uint64_t detected = is_attack(payload, length);
+
+        tm_begin
+            tm_store_u64(in->detected + packet->flow, detected + 1);
+            tm_store_u64(&in->ncompleted, tm_load_u64(&in->ncompleted) + 1);
+        tm_commit
+            tm_restart();
+        tm_end
+    }
+}
+
+static bool
+intruder_verify(void* state)
+{
+    struct intruder* in = state;
+
+    unsigned long nflows = in->nflows;
+
+    if (in->ncompleted != nflows) {
+        return false;
+    }
+
+    /* Detected flows are 2, others 1. */
+    unsigned long flow;
+    for (flow = 0; flow < nflows; ++flow) {
+        if (in->detected[flow] != 1ul + in->is_attack[flow]) {
+            return false;
+        }
+    }
+
+    unsigned long i;
+    for (i = 0; i < in->nbuckets; ++i) {
+        if (in->bucket[i]) {
+            return false; /* Incomplete flow */
+        }
+    }
+
+    return true;
+}
+
+static void
+intruder_teardown(void* state)
+{
+    struct intruder* in = state;
+
+    unsigned long i;
+    for (i = 0; i < in->npackets; ++i) {
+        free(in->packet[i]);
+    }
+
+    free(in->bucket);
+    free(in->packet);
+    free(in->detected);
+    free(in->is_attack);
+    free(in);
+}
+
+const struct stamp_app g_stamp_intruder = {
+    "intruder",
+    intruder_setup,
+    intruder_run,
+    intruder_verify,
+    intruder_teardown
+};
@@ -0,0 +1,283 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * K-means clustering
+ *
+ * Threads assign their share of the points to the nearest center,
+ * and add each point to its cluster's sums in a transaction. Between
+ * iterations, one thread computes the new centers. Transactions are
+ * short, but all threads update the same few clusters.
+ */
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stamp.h"
+
+#define KMEANS_NDIMS            (16)
+#define KMEANS_NCLUSTERS        (16)
+#define KMEANS_NPOINTS          (16384)
+#define KMEANS_MAX_NITERATIONS  (50)
+/* Stop once fewer points than this, in parts per million,
+ * change their cluster. */
+#define KMEANS_THRESHOLD_PPM    (1000)
+
+struct kmeans {
+    unsigned long     nthreads;
+    unsigned long     npoints;
+    double*           point;
+    unsigned long*    membership;
+    double            center[KMEANS_NCLUSTERS][KMEANS_NDIMS];
+    /* Updated in transactions */
+    double            sum[KMEANS_NCLUSTERS][KMEANS_NDIMS];
+    uint64_t          count[KMEANS_NCLUSTERS];
+    uint64_t          nchanged;
+    /* Set by the serial thread between iterations */
+    bool              done;
+    bool              lost_points;
+    unsigned long     niterations;
+    pthread_barrier_t barrier;
+};
+
+static double
+rand_double(struct bench_rand* rand)
+{
+    return (bench_rand_next(rand) >> 11) * (1.0 / (1ul << 53));
+}
+
+static void*
+kmeans_setup(const struct stamp_config* config)
+{
+    struct kmeans* km = bench_calloc(1, sizeof(*km));
+
+    km->nthreads = config->nthreads;
+    km->npoints = KMEANS_NPOINTS * config->scale;
+    km->point = bench_calloc(km->npoints * KMEANS_NDIMS, sizeof(*km->point));
+    km->membership = bench_calloc(km->npoints, sizeof(*km->membership));
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, config->seed);
+
+    /* Points scatter around random true centers. */
+    double truth[KMEANS_NCLUSTERS][KMEANS_NDIMS];
+
+    unsigned long c, d, i;
+    for (c = 0; c < KMEANS_NCLUSTERS; ++c) {
+        for (d = 0; d < KMEANS_NDIMS; ++d) {
+            truth[c][d] = 100 * rand_double(&rand);
+        }
+    }
+
+    for (i = 0; i < km->npoints; ++i) {
+        c = bench_rand_below(&rand, KMEANS_NCLUSTERS);
+        for (d = 0; d < KMEANS_NDIMS; ++d) {
+            km->point[i * KMEANS_NDIMS + d] = truth[c][d] +
+                10 * (rand_double(&rand) + rand_double(&rand) - 1);
+        }
+        km->membership[i] = KMEANS_NCLUSTERS; /* None */
+    }
+
+    /* Start from the first points. */
+    for (c = 0; c < KMEANS_NCLUSTERS; ++c) {
+        memcpy(km->center[c], km->point + c * KMEANS_NDIMS,
+               sizeof(km->center[c]));
+    }
+
+    int err = pthread_barrier_init(&km->barrier, NULL, km->nthreads);
+    if (err) {
+        perror("pthread_barrier_init");
+        abort();
+    }
+
+    return km;
+}
+
+static unsigned long
+nearest_center(const double (*center)[KMEANS_NDIMS], const double* point)
+{
+    unsigned long nearest = 0;
+    double min_dist = DBL_MAX;
+
+    unsigned long c;
+    for (c = 0; c < KMEANS_NCLUSTERS; ++c) {
+        double dist = 0;
+        unsigned long d;
+        for (d = 0; d < KMEANS_NDIMS; ++d) {
+            double diff = point[d] - center[c][d];
+            dist += diff * diff;
+        }
+        if (dist < min_dist) {
+            min_dist = dist;
+            nearest = c;
+        }
+    }
+
+    return nearest;
+}
+
+/* Computes the new centers; runs in a single thread. */
+static void
+update_centers(struct kmeans* km)
+{
+    uint64_t npoints = 0;
+
+    unsigned long c, d;
+    for (c = 0; c < KMEANS_NCLUSTERS; ++c) {
+        if (km->count[c]) {
+            for (d = 0; d < KMEANS_NDIMS; ++d) {
+                km->center[c][d] = km->sum[c][d] / km->count[c];
+            }
+        }
+        npoints += km->count[c];
+    }
+
+    if (npoints != km->npoints) {
+        km->lost_points = true;
+    }
+
+    ++km->niterations;
+
+    km->done = (km->nchanged * 1000000 < km->npoints * KMEANS_THRESHOLD_PPM) ||
+               (km->niterations == KMEANS_MAX_NITERATIONS);
+
+    memset(km->sum, 0, sizeof(km->sum));
+    memset(km->count, 0, sizeof(km->count));
+    km->nchanged = 0;
+}
+
+/* Adds a point to the sums of its cluster. */
+static void
+add_point(struct kmeans* km, unsigned long c, const double* point)
+{
+    tm_begin
+        unsigned long d;
+        for (d = 0; d < KMEANS_NDIMS; ++d) {
+            tm_store_double(km->sum[c] + d,
+                            tm_load_double(km->sum[c] + d) + point[d]);
+        }
+        tm_store_u64(km->count + c, tm_load_u64(km->count + c) + 1);
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static void
+add_nchanged(struct kmeans* km, uint64_t nchanged)
+{
+    tm_begin
+        tm_store_u64(&km->nchanged, tm_load_u64(&km->nchanged) + nchanged);
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static void
+kmeans_run(void* state, unsigned long index)
+{
+    struct kmeans* km = state;
+
+    unsigned long beg, end;
+    stamp_partition(km->npoints, km->nthreads, index, &beg, &end);
+
+    do {
+        uint64_t nchanged = 0;
+
+        unsigned long i;
+        for (i = beg; i < end; ++i) {
+
+            const double* point = km->point + i * KMEANS_NDIMS;
+
+            /* Centers only change between iterations. */
+            unsigned long c = nearest_center(km->center, point);
+
+            if (km->membership[i] != c) {
+                km->membership[i] = c;
+                ++nchanged;
+            }
+
+            add_point(km, c, point);
+        }
+
+        add_nchanged(km, nchanged);
+
+        if (bench_barrier_wait(&km->barrier)) {
+            update_centers(km);
+        }
+        bench_barrier_wait(&km->barrier);
+
+    } while (!km->done);
+}
+
+static bool
+kmeans_verify(void* state)
+{
+    struct kmeans* km = state;
+
+    if (km->lost_points) {
+        return false;
+    }
+
+    /* Each center is the mean of its cluster's points. */
+    double sum[KMEANS_NCLUSTERS][KMEANS_NDIMS];
+    unsigned long count[KMEANS_NCLUSTERS];
+
+    memset(sum, 0, sizeof(sum));
+    memset(count, 0, sizeof(count));
+
+    unsigned long c, d, i;
+    for (i = 0; i < km->npoints; ++i) {
+        c = km->membership[i];
+        if (c >= KMEANS_NCLUSTERS) {
+            return false;
+        }
+        for (d = 0; d < KMEANS_NDIMS; ++d) {
+            sum[c][d] += km->point[i * KMEANS_NDIMS + d];
+        }
+        ++count[c];
+    }
+
+    for (c = 0; c < KMEANS_NCLUSTERS; ++c) {
+        if (!count[c]) {
+            continue;
+        }
+        for (d = 0; d < KMEANS_NDIMS; ++d) {
+            double mean = sum[c][d] / count[c];
+            double diff = mean - km->center[c][d];
+            /* Sums in different order differ in the last bits. */
+            if ((diff > 1e-6) || (diff < -1e-6)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void
+kmeans_teardown(void* state)
+{
+    struct kmeans* km = state;
+
+    pthread_barrier_destroy(&km->barrier);
+    free(km->membership);
+    free(km->point);
+    free(km);
+}
+
+const struct stamp_app g_stamp_kmeans = {
+    "kmeans",
+    kmeans_setup,
+    kmeans_run,
+    kmeans_verify,
+    kmeans_teardown
+};
@@ -0,0 +1,353 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Maze routing (Lee's algorithm)
+ *
+ * Threads take pairs of endpoints from a shared work list and route
+ * a path between them through a 3D grid. Each thread searches on a
+ * private copy of the grid, then claims all cells of the path in a
+ * single transaction. If another thread claimed one of the cells in
+ * the meantime, the thread searches again. Transactions read and
+ * write hundreds of cells.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stamp.h"
+
+#define LABYRINTH_WIDTH     (64)
+#define LABYRINTH_DEPTH     (3)
+#define LABYRINTH_NPATHS    (96)
+
+struct labyrinth_path {
+    unsigned long src;
+    unsigned long dst;
+    /* Number of cells if routed, or 0 */
+    unsigned long length;
+};
+
+struct labyrinth {
+    unsigned long          nthreads;
+    unsigned long          width;
+    unsigned long          ncells;
+    unsigned long          npaths;
+    struct labyrinth_path* path;
+    /* Updated in transactions; 0 if free, or the path index + 1 */
+    uint64_t*              grid;
+    uint64_t               next_path;
+};
+
+/* Private state of a thread */
+struct labyrinth_search {
+    uint64_t*      grid;
+    long*          dist;
+    unsigned long* queue;
+    unsigned long* cells;
+};
+
+static void*
+labyrinth_setup(const struct stamp_config* config)
+{
+    struct labyrinth* lab = bench_calloc(1, sizeof(*lab));
+
+    lab->nthreads = config->nthreads;
+    lab->width = LABYRINTH_WIDTH * config->scale;
+    lab->ncells = lab->width * lab->width * LABYRINTH_DEPTH;
+    lab->npaths = LABYRINTH_NPATHS * config->scale;
+    lab->path = bench_calloc(lab->npaths, sizeof(*lab->path));
+    lab->grid = bench_calloc(lab->ncells, sizeof(*lab->grid));
+
+    /* Endpoints are distinct cells. */
+    uint8_t* used = bench_calloc(lab->ncells, sizeof(*used));
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, config->seed);
+
+    unsigned long i;
+    for (i = 0; i < 2 * lab->npaths; ++i) {
+        unsigned long cell;
+        do {
+            cell = bench_rand_below(&rand, lab->ncells);
+        } while (used[cell]);
+        used[cell] = 1;
+
+        if (i & 1) {
+            lab->path[i / 2].dst = cell;
+        } else {
+            lab->path[i / 2].src = cell;
+        }
+    }
+
+    free(used);
+
+    return lab;
+}
+
+/* Stores the up to six neighbors of cell in neighbor and returns
+ * their number. */
+static unsigned long
+neighbors(const struct labyrinth* lab, unsigned long cell,
+          unsigned long* neighbor)
+{
+    unsigned long area = lab->width * lab->width;
+    unsigned long x = cell % lab->width;
+    unsigned long y = (cell / lab->width) % lab->width;
+    unsigned long z = cell / area;
+
+    unsigned long n = 0;
+
+    if (x > 0) {
+        neighbor[n++] = cell - 1;
+    }
+    if (x + 1 < lab->width) {
+        neighbor[n++] = cell + 1;
+    }
+    if (y > 0) {
+        neighbor[n++] = cell - lab->width;
+    }
+    if (y + 1 < lab->width) {
+        neighbor[n++] = cell + lab->width;
+    }
+    if (z > 0) {
+        neighbor[n++] = cell - area;
+    }
+    if (z + 1 < LABYRINTH_DEPTH) {
+        neighbor[n++] = cell + area;
+    }
+
+    return n;
+}
+
+/* Searches a shortest path through free cells of the private grid.
+ * Stores its cells in search->cells and returns their number, or
+ * returns 0 if there's no path. */
+static unsigned long
+find_path(const struct labyrinth* lab, struct labyrinth_search* search,
+          const struct labyrinth_path* path)
+{
+    /* Other paths might run through our endpoints. */
+    if (search->grid[path->src] || search->grid[path->dst]) {
+        return 0;
+    }
+
+    unsigned long i;
+    for (i = 0; i < lab->ncells; ++i) {
+        search->dist[i] = -1;
+    }
+
+    /* Expand from the source... */
+    unsigned long head = 0;
+    unsigned long tail = 0;
+
+    search->dist[path->src] = 0;
+    search->queue[tail++] = path->src;
+
+    while ((head < tail) && (search->dist[path->dst] < 0)) {
+
+        unsigned long cell = search->queue[head++];
+
+        unsigned long neighbor[6];
+        unsigned long n = neighbors(lab, cell, neighbor);
+
+        for (i = 0; i < n; ++i) {
+            unsigned long next = neighbor[i];
+            if ((search->dist[next] < 0) &&
+                (!search->grid[next] || (next == path->dst))) {
+                search->dist[next] = search->dist[cell] + 1;
+                search->queue[tail++] = next;
+            }
+        }
+    }
+
+    if (search->dist[path->dst] < 0) {
+        return 0;
+    }
+
+    /* ...and trace back from the destination. */
+    unsigned long length = search->dist[path->dst] + 1;
+    unsigned long cell = path->dst;
+
+    search->cells[length - 1] = cell;
+
+    long d;
+    for (d = length - 2; d >= 0; --d) {
+        unsigned long neighbor[6];
+        unsigned long n = neighbors(lab, cell, neighbor);
+        for (i = 0; i < n; ++i) {
+            if (search->dist[neighbor[i]] == d) {
+                break;
+            }
+        }
+        cell = neighbor[i];
+        search->cells[d] = cell;
+    }
+
+    return length;
+}
+
+static void
+labyrinth_run(void* state, unsigned long index)
+{
+    struct labyrinth* lab = state;
+
+    struct labyrinth_search search = {
+        .grid  = bench_calloc(lab->ncells, sizeof(*search.grid)),
+        .dist  = bench_calloc(lab->ncells, sizeof(*search.dist)),
+        .queue = bench_calloc(lab->ncells, sizeof(*search.queue)),
+        .cells = bench_calloc(lab->ncells, sizeof(*search.cells))
+    };
+
+    while (true) {
+
+        tm_save uint64_t p = 0;
+
+        tm_begin
+            p = tm_load_u64(&lab->next_path);
+            if (p < lab->npaths) {
+                tm_store_u64(&lab->next_path, p + 1);
+            }
+        tm_commit
+            tm_restart();
+        tm_end
+
+        if (p >= lab->npaths) {
+            break;
+        }
+
+        struct labyrinth_path* path = lab->path + p;
+
+        tm_save bool claimed = false;
+
+        do {
+            /* The copy might be inconsistent; the transaction
+             * below validates the cells we use. */
+            memcpy(search.grid, lab->grid, lab->ncells * sizeof(*search.grid));
+
+            unsigned long length = find_path(lab, &search, path);
+            if (!length) {
+                break;
+            }
+
+            tm_begin
+                claimed = false;
+
+                unsigned long i;
+                for (i = 0; i < length; ++i) {
+                    if (tm_load_u64(lab->grid + search.cells[i])) {
+                        break;
+                    }
+                }
+                if (i == length) {
+                    for (i = 0; i < length; ++i) {
+                        tm_store_u64(lab->grid + search.cells[i], p + 1);
+                    }
+                    claimed = true;
+                }
+            tm_commit
+                tm_restart();
+            tm_end
+
+            if (claimed) {
+                path->length = length;
+            }
+
+        } while (!claimed);
+    }
+
+    free(search.cells);
+    free(search.queue);
+    free(search.dist);
+    free(search.grid);
+}
+
+static bool
+labyrinth_verify(void* state)
+{
+    struct labyrinth* lab = state;
+
+    unsigned long* ncells = bench_calloc(lab->npaths + 1, sizeof(*ncells));
+
+    unsigned long i;
+    for (i = 0; i < lab->ncells; ++i) {
+        if (lab->grid[i] > lab->npaths) {
+            free(ncells);
+            return false;
+        }
+        ++ncells[lab->grid[i]];
+    }
+
+    bool ok = true;
+    unsigned long nrouted = 0;
+
+    for (i = 0; ok && (i < lab->npaths); ++i) {
+
+        const struct labyrinth_path* path = lab->path + i;
+        uint64_t id = i + 1;
+
+        ok = ncells[id] == path->length;
+        if (!ok || !path->length) {
+            continue;
+        }
+        ++nrouted;
+
+        /* Walk from the source to the destination along the path's
+         * cells; shortest paths never touch themselves. */
+        unsigned long prev = lab->ncells;
+        unsigned long cell = path->src;
+        unsigned long length = 1;
+
+        ok = lab->grid[cell] == id;
+
+        while (ok && (cell != path->dst)) {
+            unsigned long neighbor[6];
+            unsigned long n = neighbors(lab, cell, neighbor);
+            unsigned long next = lab->ncells;
+            unsigned long j;
+            for (j = 0; j < n; ++j) {
+                if ((neighbor[j] != prev) && (lab->grid[neighbor[j]] == id)) {
+                    next = neighbor[j];
+                    break;
+                }
+            }
+            ok = next < lab->ncells;
+            prev = cell;
+            cell = next;
+            ++length;
+        }
+
+        ok = ok && (length == path->length);
+    }
+
+    free(ncells);
+
+    /* Most paths should be routable. */
+    return ok && (nrouted > lab->npaths / 2);
+}
+
+static void
+labyrinth_teardown(void* state)
+{
+    struct labyrinth* lab = state;
+
+    free(lab->grid);
+    free(lab->path);
+    free(lab);
+}
+
+const struct stamp_app g_stamp_labyrinth = {
+    "labyrinth",
+    labyrinth_setup,
+    labyrinth_run,
+    labyrinth_verify,
+    labyrinth_teardown
+};
@@ -0,0 +1,223 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Graph construction (SSCA2, kernel 1)
+ *
+ * Threads build the adjacency arrays of a directed graph from a list
+ * of edges. First they count each vertex's out-degree, then each
+ * reserves a slot in its source vertex's array for every edge. The
+ * edges follow an R-MAT distribution, so a few vertices have many
+ * edges, and transactions on those conflict.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stamp.h"
+
+#define SSCA2_NVERTICES_BITSHIFT    (13)
+#define SSCA2_NEDGES_PER_VERTEX     (8)
+
+struct ssca2 {
+    unsigned long     nthreads;
+    unsigned long     nvertices;
+    unsigned long     nedges;
+    uint64_t*         src;
+    uint64_t*         dst;
+    /* Updated in transactions */
+    uint64_t*         degree;
+    uint64_t*         fill;
+    uint64_t*         adj;
+    /* Start of each vertex's adjacency array; nvertices + 1 entries */
+    uint64_t*         offset;
+    pthread_barrier_t barrier;
+};
+
+/* Draws an edge of an R-MAT graph with partition probabilities
+ * 0.55, 0.1, 0.1 and 0.25. */
+static void
+rmat_edge(struct bench_rand* rand, unsigned long nbits,
+          uint64_t* src, uint64_t* dst)
+{
+    *src = 0;
+    *dst = 0;
+
+    unsigned long i;
+    for (i = 0; i < nbits; ++i) {
+        uint64_t p = bench_rand_below(rand, 100);
+        *src = (*src << 1) | (p >= 65);
+        *dst = (*dst << 1) | ((p >= 55 && p < 65) || (p >= 75));
+    }
+}
+
+static void*
+ssca2_setup(const struct stamp_config* config)
+{
+    struct ssca2* g = bench_calloc(1, sizeof(*g));
+
+    unsigned long nbits = SSCA2_NVERTICES_BITSHIFT;
+    while ((1ul << (nbits - SSCA2_NVERTICES_BITSHIFT)) < config->scale) {
+        ++nbits;
+    }
+
+    g->nthreads = config->nthreads;
+    g->nvertices = 1ul << nbits;
+    g->nedges = g->nvertices * SSCA2_NEDGES_PER_VERTEX;
+
+    g->src = bench_calloc(g->nedges, sizeof(*g->src));
+    g->dst = bench_calloc(g->nedges, sizeof(*g->dst));
+    g->degree = bench_calloc(g->nvertices, sizeof(*g->degree));
+    g->fill = bench_calloc(g->nvertices, sizeof(*g->fill));
+    g->adj = bench_calloc(g->nedges, sizeof(*g->adj));
+    g->offset = bench_calloc(g->nvertices + 1, sizeof(*g->offset));
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, config->seed);
+
+    unsigned long i;
+    for (i = 0; i < g->nedges; ++i) {
+        rmat_edge(&rand, nbits, g->src + i, g->dst + i);
+    }
+
+    int err = pthread_barrier_init(&g->barrier, NULL, g->nthreads);
+    if (err) {
+        perror("pthread_barrier_init");
+        abort();
+    }
+
+    return g;
+}
+
+static void
+add_degree(uint64_t* degree)
+{
+    tm_begin
+        tm_store_u64(degree, tm_load_u64(degree) + 1);
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+/* Reserves the next slot of a vertex' adjacency array. */
+static void
+append_edge(uint64_t* fill, uint64_t* adj, uint64_t dst)
+{
+    tm_begin
+        uint64_t pos = tm_load_u64(fill);
+        tm_store_u64(fill, pos + 1);
+        tm_store_u64(adj + pos, dst);
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static void
+ssca2_run(void* state, unsigned long index)
+{
+    struct ssca2* g = state;
+
+    unsigned long beg, end, i;
+    stamp_partition(g->nedges, g->nthreads, index, &beg, &end);
+
+    /* Count out-degrees... */
+    for (i = beg; i < end; ++i) {
+        add_degree(g->degree + g->src[i]);
+    }
+
+    /* ...lay out the adjacency arrays... */
+    if (bench_barrier_wait(&g->barrier)) {
+        unsigned long v;
+        for (v = 0; v < g->nvertices; ++v) {
+            g->offset[v + 1] = g->offset[v] + g->degree[v];
+        }
+    }
+    bench_barrier_wait(&g->barrier);
+
+    /* ...and fill them. */
+    for (i = beg; i < end; ++i) {
+        uint64_t v = g->src[i];
+        append_edge(g->fill + v, g->adj + g->offset[v], g->dst[i]);
+    }
+}
+
+static int
+compare_u64(const void* lhs, const void* rhs)
+{
+    uint64_t l = *(const uint64_t*)lhs;
+    uint64_t r = *(const uint64_t*)rhs;
+
+    return (l > r) - (l < r);
+}
+
+static bool
+ssca2_verify(void* state)
+{
+    struct ssca2* g = state;
+
+    /* Build the graph sequentially by counting sort and compare. */
+    uint64_t* offset = bench_calloc(g->nvertices + 1, sizeof(*offset));
+    uint64_t* adj = bench_calloc(g->nedges, sizeof(*adj));
+
+    unsigned long i, v;
+    for (i = 0; i < g->nedges; ++i) {
+        ++offset[g->src[i] + 1];
+    }
+    for (v = 0; v < g->nvertices; ++v) {
+        offset[v + 1] += offset[v];
+    }
+
+    bool ok = !memcmp(offset, g->offset, (g->nvertices + 1) * sizeof(*offset));
+
+    uint64_t* fill = bench_calloc(g->nvertices, sizeof(*fill));
+    for (i = 0; ok && (i < g->nedges); ++i) {
+        v = g->src[i];
+        adj[offset[v] + fill[v]++] = g->dst[i];
+    }
+
+    for (v = 0; ok && (v < g->nvertices); ++v) {
+        uint64_t n = offset[v + 1] - offset[v];
+        ok = g->fill[v] == n;
+        qsort(adj + offset[v], n, sizeof(*adj), compare_u64);
+        qsort(g->adj + offset[v], n, sizeof(*adj), compare_u64);
+    }
+
+    ok = ok && !memcmp(adj, g->adj, g->nedges * sizeof(*adj));
+
+    free(fill);
+    free(adj);
+    free(offset);
+
+    return ok;
+}
+
+static void
+ssca2_teardown(void* state)
+{
+    struct ssca2* g = state;
+
+    pthread_barrier_destroy(&g->barrier);
+    free(g->offset);
+    free(g->adj);
+    free(g->fill);
+    free(g->degree);
+    free(g->dst);
+    free(g->src);
+    free(g);
+}
+
+const struct stamp_app g_stamp_ssca2 = {
+    "ssca2",
+    ssca2_setup,
+    ssca2_run,
+    ssca2_verify,
+    ssca2_teardown
+};
@@ -0,0 +1,336 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Travel reservation system
+ *
+ * Clients run three kinds of transactions on tables of cars, flights
+ * and rooms, and on a table of customers. Most query a few random
+ * items and reserve the most expensive one of each kind for a
+ * customer; some delete a customer with all reservations; others add
+ * or remove items. Reservations are lists from malloc_tx().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+#include "stamp.h"
+
+#define VACATION_NRELATIONS         (16384)
+#define VACATION_NTRANSACTIONS      (65536)
+#define VACATION_NQUERIES           (4)
+/* Queries go to the first part of each table. */
+#define VACATION_QUERY_PERCENT      (60)
+#define VACATION_USER_PERCENT       (90)
+#define VACATION_CAPACITY           (100)
+
+enum item_type {
+    ITEM_CAR,
+    ITEM_FLIGHT,
+    ITEM_ROOM,
+    NITEM_TYPES
+};
+
+struct vacation_item {
+    uint64_t exists;
+    uint64_t total;
+    uint64_t used;
+    uint64_t free;
+    uint64_t price;
+};
+
+struct vacation_reservation {
+    uint64_t                     type;
+    uint64_t                     id;
+    uint64_t                     price;
+    struct vacation_reservation* next;
+};
+
+struct vacation_customer {
+    uint64_t                     exists;
+    struct vacation_reservation* reservation;
+};
+
+struct vacation {
+    unsigned long             nthreads;
+    unsigned long             nrelations;
+    unsigned long             ntransactions;
+    uint64_t                  seed;
+    /* Updated in transactions */
+    struct vacation_item*     item[NITEM_TYPES];
+    struct vacation_customer* customer;
+};
+
+static void*
+vacation_setup(const struct stamp_config* config)
+{
+    struct vacation* vac = bench_calloc(1, sizeof(*vac));
+
+    vac->nthreads = config->nthreads;
+    vac->nrelations = VACATION_NRELATIONS * config->scale;
+    vac->ntransactions = VACATION_NTRANSACTIONS * config->scale;
+    vac->seed = config->seed;
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, config->seed);
+
+    unsigned long type, i;
+    for (type = 0; type < NITEM_TYPES; ++type) {
+        vac->item[type] = bench_calloc(vac->nrelations, sizeof(*vac->item[type]));
+        for (i = 0; i < vac->nrelations; ++i) {
+            struct vacation_item* item = vac->item[type] + i;
+            item->exists = 1;
+            item->total = VACATION_CAPACITY;
+            item->free = VACATION_CAPACITY;
+            item->price = 50 + bench_rand_below(&rand, 50) * 10;
+        }
+    }
+
+    vac->customer = bench_calloc(vac->nrelations, sizeof(*vac->customer));
+    for (i = 0; i < vac->nrelations; ++i) {
+        vac->customer[i].exists = 1;
+    }
+
+    return vac;
+}
+
+/* Queries random items and reserves the most expensive one of each
+ * type for a customer. */
+static void
+make_reservation(struct vacation* vac, struct bench_rand* rand)
+{
+    unsigned long query_range = vac->nrelations * VACATION_QUERY_PERCENT / 100;
+
+    uint64_t type[VACATION_NQUERIES];
+    uint64_t id[VACATION_NQUERIES];
+
+    unsigned long i;
+    for (i = 0; i < VACATION_NQUERIES; ++i) {
+        type[i] = bench_rand_below(rand, NITEM_TYPES);
+        id[i] = bench_rand_below(rand, query_range);
+    }
+    uint64_t customer_id = bench_rand_below(rand, query_range);
+
+    tm_begin
+        /* Find the most expensive available item of each type... */
+        uint64_t max_price[NITEM_TYPES] = {0, 0, 0};
+        uint64_t max_id[NITEM_TYPES] = {0, 0, 0};
+
+        unsigned long i;
+        for (i = 0; i < VACATION_NQUERIES; ++i) {
+            struct vacation_item* item = vac->item[type[i]] + id[i];
+            if (tm_load_u64(&item->exists) && tm_load_u64(&item->free)) {
+                uint64_t price = tm_load_u64(&item->price);
+                if (price > max_price[type[i]]) {
+                    max_price[type[i]] = price;
+                    max_id[type[i]] = id[i];
+                }
+            }
+        }
+
+        /* ...and reserve them. */
+        struct vacation_customer* customer = vac->customer + customer_id;
+
+        unsigned long t;
+        for (t = 0; t < NITEM_TYPES; ++t) {
+
+            if (!max_price[t]) {
+                continue;
+            }
+
+            if (!tm_load_u64(&customer->exists)) {
+                tm_store_u64(&customer->exists, 1);
+            }
+
+            struct vacation_item* item = vac->item[t] + max_id[t];
+            tm_store_u64(&item->used, tm_load_u64(&item->used) + 1);
+            tm_store_u64(&item->free, tm_load_u64(&item->free) - 1);
+
+            struct vacation_reservation* res = malloc_tx(sizeof(*res));
+            res->type = t;
+            res->id = max_id[t];
+            res->price = max_price[t];
+            res->next = tm_load_ptr((void* const*)&customer->reservation);
+            tm_store_ptr((void**)&customer->reservation, res);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+/* Deletes a customer and cancels all reservations. */
+static void
+delete_customer(struct vacation* vac, struct bench_rand* rand)
+{
+    unsigned long query_range = vac->nrelations * VACATION_QUERY_PERCENT / 100;
+
+    struct vacation_customer* customer =
+        vac->customer + bench_rand_below(rand, query_range);
+
+    tm_begin
+        if (tm_load_u64(&customer->exists)) {
+
+            struct vacation_reservation* res =
+                tm_load_ptr((void* const*)&customer->reservation);
+
+            while (res) {
+                struct vacation_item* item = vac->item[tm_load_u64(&res->type)] +
+                                             tm_load_u64(&res->id);
+                tm_store_u64(&item->used, tm_load_u64(&item->used) - 1);
+                tm_store_u64(&item->free, tm_load_u64(&item->free) + 1);
+
+                struct vacation_reservation* next =
+                    tm_load_ptr((void* const*)&res->next);
+                free_tx(res);
+                res = next;
+            }
+
+            tm_store_ptr((void**)&customer->reservation, NULL);
+            tm_store_u64(&customer->exists, 0);
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+/* Adds capacity to random items, or removes unused ones. */
+static void
+update_tables(struct vacation* vac, struct bench_rand* rand)
+{
+    unsigned long query_range = vac->nrelations * VACATION_QUERY_PERCENT / 100;
+
+    uint64_t type[VACATION_NQUERIES];
+    uint64_t id[VACATION_NQUERIES];
+    uint64_t price[VACATION_NQUERIES];
+
+    unsigned long i;
+    for (i = 0; i < VACATION_NQUERIES; ++i) {
+        type[i] = bench_rand_below(rand, NITEM_TYPES);
+        id[i] = bench_rand_below(rand, query_range);
+        /* Removes items for a price of 0 */
+        price[i] = bench_rand_below(rand, 2) ? 50 + bench_rand_below(rand, 50) * 10 : 0;
+    }
+
+    tm_begin
+        unsigned long i;
+        for (i = 0; i < VACATION_NQUERIES; ++i) {
+
+            struct vacation_item* item = vac->item[type[i]] + id[i];
+
+            if (price[i]) {
+                if (!tm_load_u64(&item->exists)) {
+                    tm_store_u64(&item->exists, 1);
+                }
+                tm_store_u64(&item->total, tm_load_u64(&item->total) + VACATION_CAPACITY);
+                tm_store_u64(&item->free, tm_load_u64(&item->free) + VACATION_CAPACITY);
+                tm_store_u64(&item->price, price[i]);
+            } else if (tm_load_u64(&item->exists) && !tm_load_u64(&item->used)) {
+                tm_store_u64(&item->exists, 0);
+                tm_store_u64(&item->total, 0);
+                tm_store_u64(&item->free, 0);
+            }
+        }
+    tm_commit
+        tm_restart();
+    tm_end
+}
+
+static void
+vacation_run(void* state, unsigned long index)
+{
+    struct vacation* vac = state;
+
+    struct bench_rand rand;
+    bench_rand_init(&rand, vac->seed + index + 1);
+
+    unsigned long beg, end, i;
+    stamp_partition(vac->ntransactions, vac->nthreads, index, &beg, &end);
+
+    for (i = beg; i < end; ++i) {
+        unsigned long r = bench_rand_below(&rand, 100);
+        if (r < VACATION_USER_PERCENT) {
+            make_reservation(vac, &rand);
+        } else if (r & 1) {
+            delete_customer(vac, &rand);
+        } else {
+            update_tables(vac, &rand);
+        }
+    }
+}
+
+static bool
+vacation_verify(void* state)
+{
+    struct vacation* vac = state;
+
+    /* Count reservations per item... */
+    uint64_t* nreserved[NITEM_TYPES];
+
+    unsigned long type, i;
+    for (type = 0; type < NITEM_TYPES; ++type) {
+        nreserved[type] = bench_calloc(vac->nrelations, sizeof(*nreserved[type]));
+    }
+
+    bool ok = true;
+
+    for (i = 0; i < vac->nrelations; ++i) {
+        const struct vacation_customer* customer = vac->customer + i;
+        const struct vacation_reservation* res = customer->reservation;
+        ok = ok && (customer->exists || !res);
+        for (; res; res = res->next) {
+            ++nreserved[res->type][res->id];
+        }
+    }
+
+    /* ...and compare with the tables. */
+    for (type = 0; type < NITEM_TYPES; ++type) {
+        for (i = 0; ok && (i < vac->nrelations); ++i) {
+            const struct vacation_item* item = vac->item[type] + i;
+            ok = (item->used == nreserved[type][i]) &&
+                 (item->used + item->free == item->total) &&
+                 (item->exists || !item->total);
+        }
+        free(nreserved[type]);
+    }
+
+    return ok;
+}
+
+static void
+vacation_teardown(void* state)
+{
+    struct vacation* vac = state;
+
+    unsigned long type, i;
+    for (i = 0; i < vac->nrelations; ++i) {
+        struct vacation_reservation* res = vac->customer[i].reservation;
+        while (res) {
+            struct vacation_reservation* next = res->next;
+            slab_free(res);
+            res = next;
+        }
+    }
+
+    for (type = 0; type < NITEM_TYPES; ++type) {
+        free(vac->item[type]);
+    }
+    free(vac->customer);
+    free(vac);
+}
+
+const struct stamp_app g_stamp_vacation = {
+    "vacation",
+    vacation_setup,
+    vacation_run,
+    vacation_verify,
+    vacation_teardown
+};
@@ -0,0 +1,63 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "bench.h"
+#include "stdlib-tx.h"
+#include "tm-access.h"
+
+/*
+ * STAMP-style applications for bench-stamp
+ *
+ * Each application generates its input from a seed, runs its
+ * parallel phase in all threads, and verifies the result. SCALE
+ * multiplies the size of the input.
+ */
+
+struct stamp_config {
+    unsigned long nthreads;
+    unsigned long scale;
+    uint64_t      seed;
+};
+
+struct stamp_app {
+    const char* name;
+    /* Generates the input; returns the application's state. */
+    void* (*setup)(const struct stamp_config* config);
+    /* Runs in each thread, with index from 0 to nthreads - 1. */
+    void  (*run)(void* state, unsigned long index);
+    /* Returns true if the result is correct. */
+    bool  (*verify)(void* state);
+    void  (*teardown)(void* state);
+};
+
+/**
+ * Splits n items evenly among threads and returns thread index's
+ * range [*beg, *end).
+ */
+static inline void
+stamp_partition(unsigned long n, unsigned long nthreads, unsigned long index,
+                unsigned long* beg, unsigned long* end)
+{
+    *beg = n * index / nthreads;
+    *end = n * (index + 1) / nthreads;
+}
+
+extern const struct stamp_app g_stamp_genome;
+extern const struct stamp_app g_stamp_intruder;
+extern const struct stamp_app g_stamp_kmeans;
+extern const struct stamp_app g_stamp_labyrinth;
+extern const struct stamp_app g_stamp_ssca2;
+extern const struct stamp_app g_stamp_vacation;
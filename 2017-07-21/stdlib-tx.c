@@ -11,27 +11,28 @@
 
 #include "stdlib-tx.h"
 #include <errno.h>
-#include <time.h>
+#include "epoch.h"
+#include "fault.h"
+#include "slab.h"
 #include "tm.h"
 
 static void
 undo_malloc_tx(uintptr_t data)
 {
     void* ptr = (void*)data;
-    free(ptr);
+    slab_free(ptr);
 }
 
 static void*
 malloc_with_low_mem(size_t size)
 {
     /* simulate spurious allocation failures */
-    clock_t cputime = clock();
-    if (!(cputime % 3)) {
+    if (fault_inject(FAULT_ALLOC)) {
         errno = ENOMEM;
         return NULL;
     }
 
-    return malloc(size);
+    return slab_alloc(size);
 }
 
 void*
@@ -52,8 +53,9 @@ malloc_tx(size_t size)
 static void
 apply_free_tx(uintptr_t data)
 {
+    /* Concurrent transactions might still read from ptr. */
     void* ptr = (void*)data;
-    free(ptr);
+    epoch_retire(ptr, slab_free);
 }
 
 void
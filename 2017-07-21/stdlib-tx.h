@@ -13,8 +13,17 @@
 
 #include <stdlib.h>
 
+/**
+ * Allocates memory within a transaction. The memory comes from the
+ * current thread's slab cache and goes back there if the transaction
+ * rolls back.
+ */
 void*
 malloc_tx(size_t size);
 
+/**
+ * Frees memory from malloc_tx() after the transaction commits, once
+ * no concurrent transaction can read it anymore.
+ */
 void
 free_tx(void* ptr);
@@ -0,0 +1,106 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "thread.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+__thread unsigned long t_thread_id;
+
+static pthread_once_t  g_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t   g_thread_key;
+static pthread_mutex_t g_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Id 0 is reserved for 'no thread'. */
+static bool g_thread_used[NTHREADS] = { true };
+
+static void
+lock_threads(void)
+{
+    int err = pthread_mutex_lock(&g_thread_lock);
+    if (err) {
+        errno = err;
+        perror("pthread_mutex_lock");
+        abort();
+    }
+}
+
+static void
+unlock_threads(void)
+{
+    int err = pthread_mutex_unlock(&g_thread_lock);
+    if (err) {
+        errno = err;
+        perror("pthread_mutex_unlock");
+        abort();
+    }
+}
+
+static void
+release_thread_id(void* data)
+{
+    unsigned long id = (unsigned long)(uintptr_t)data;
+
+    lock_threads();
+    g_thread_used[id] = false;
+    unlock_threads();
+}
+
+static void
+init_thread_key(void)
+{
+    int err = pthread_key_create(&g_thread_key, release_thread_id);
+    if (err) {
+        errno = err;
+        perror("pthread_key_create");
+        abort();
+    }
+}
+
+unsigned long
+_thread_id_slow(void)
+{
+    int err = pthread_once(&g_thread_once, init_thread_key);
+    if (err) {
+        errno = err;
+        perror("pthread_once");
+        abort();
+    }
+
+    lock_threads();
+
+    unsigned long id = 1;
+    while ((id < NTHREADS) && g_thread_used[id]) {
+        ++id;
+    }
+    if (id == NTHREADS) {
+        fprintf(stderr, "Out of thread ids\n");
+        abort(); /* More than NTHREADS concurrent threads */
+    }
+    g_thread_used[id] = true;
+
+    unlock_threads();
+
+    /* The key's destructor returns the id when the thread exits. */
+    err = pthread_setspecific(g_thread_key, (void*)(uintptr_t)id);
+    if (err) {
+        errno = err;
+        perror("pthread_setspecific");
+        abort();
+    }
+
+    t_thread_id = id;
+
+    return id;
+}
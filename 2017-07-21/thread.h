@@ -0,0 +1,49 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define NTHREADS_BITSHIFT   (10)
+#define NTHREADS            (1ul << NTHREADS_BITSHIFT)
+
+/* Compact id of the current thread, or 0 if none has been assigned
+ * yet. Don't use directly; call thread_id() instead. */
+extern __thread unsigned long t_thread_id;
+
+unsigned long
+_thread_id_slow(void);
+
+/**
+ * Returns a compact, non-zero id for the current thread. Ids are
+ * unique among all running threads and smaller than NTHREADS. An
+ * exiting thread's id is recycled.
+ */
+static inline unsigned long
+thread_id(void)
+{
+    if (__builtin_expect(!!t_thread_id, 1)) {
+        return t_thread_id;
+    }
+    return _thread_id_slow();
+}
+
+/**
+ * Hints the CPU that the current thread spins on a lock or flag.
+ */
+static inline void
+cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
@@ -0,0 +1,96 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include "tm.h"
+#include "conflict.h"
+
+/* The engine's single-granule accesses; the Makefile sets the
+ * header of the selected engine. */
+#ifndef TM_ENGINE_HEADER
+#define TM_ENGINE_HEADER "tm-own.h"
+#endif
+#include TM_ENGINE_HEADER
+
+#if TM_GRANULE_NBYTES < 8
+#error "Typed accessors require granules of at least 8 bytes"
+#endif
+
+/*
+ * Typed accessors
+ *
+ * A naturally aligned value of up to 8 bytes never crosses a granule,
+ * so the accessors below compile to the engine's single-granule code
+ * with a constant size. Misaligned values go through load() and
+ * store().
+ */
+
+static inline void
+_tm_load_typed(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(conflict_here());
+
+    if (__builtin_expect(!(addr & (siz - 1)), 1)) {
+        _tm_load_slot(addr, buf, siz);
+    } else {
+        load(addr, buf, siz);
+    }
+}
+
+static inline void
+_tm_store_typed(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(conflict_here());
+
+    if (__builtin_expect(!(addr & (siz - 1)), 1)) {
+        _tm_store_slot(addr, buf, siz);
+    } else {
+        store(addr, buf, siz);
+    }
+}
+
+#define _TM_ACCESSORS(_name, _type)                              \
+    static inline _type                                          \
+    tm_load_##_name(_type const* addr)                           \
+    {                                                            \
+        _type value;                                             \
+        _tm_load_typed((uintptr_t)addr, &value, sizeof(value));  \
+        return value;                                            \
+    }                                                            \
+                                                                 \
+    static inline void                                           \
+    tm_store_##_name(_type* addr, _type value)                   \
+    {                                                            \
+        _tm_store_typed((uintptr_t)addr, &value, sizeof(value)); \
+    }
+
+_TM_ACCESSORS(u8,     uint8_t)
+_TM_ACCESSORS(u16,    uint16_t)
+_TM_ACCESSORS(u32,    uint32_t)
+_TM_ACCESSORS(u64,    uint64_t)
+_TM_ACCESSORS(ptr,    void*)
+_TM_ACCESSORS(double, double)
+_TM_ACCESSORS(int,    int)
+
+#undef _TM_ACCESSORS
+
+static inline int
+load_int(const int* addr)
+{
+    return tm_load_int(addr);
+}
+
+static inline void
+store_int(int* addr, int value)
+{
+    tm_store_int(addr, value);
+}
@@ -0,0 +1,57 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include "tm.h"
+
+/* Maximum number of granules that the range functions acquire
+ * before copying */
+#define TM_RANGE_NGRANULES  (64)
+
+/*
+ * Engine interface
+ *
+ * Each engine implements privatize(), load(), store(), tm_load_range()
+ * and tm_store_range() from tm.h, plus the hooks below. Exactly one engine is linked into the
+ * program; select it with the Makefile's TM_ENGINE variable.
+ *
+ * The engine's header, tm-<engine>.h, defines TM_GRANULE_NBYTES and
+ * the inline functions _tm_load_slot() and _tm_store_slot() for
+ * accesses within a single granule. The typed accessors in
+ * tm-access.h build on them.
+ */
+
+/**
+ * Called whenever a transaction starts or restarts.
+ */
+void
+_tm_engine_begin(struct _tm_tx* tx);
+
+/**
+ * Makes the transaction's stores visible. Calls _tm_restart() if
+ * the transaction cannot commit.
+ */
+void
+_tm_engine_commit(struct _tm_tx* tx);
+
+/**
+ * Discards the transaction's stores and releases its resources.
+ */
+void
+_tm_engine_rollback(struct _tm_tx* tx);
+
+/**
+ * Returns the current thread's statistics. Engines add the acquired
+ * resources and written bytes of committing transactions.
+ */
+struct tm_stats*
+_tm_thread_stats(void);
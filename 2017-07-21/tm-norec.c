@@ -0,0 +1,313 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * NOrec engine
+ *
+ * There's no per-location metadata. A single global sequence lock
+ * is odd while a transaction writes back its redo log. Loads record
+ * the values they read. Whenever the sequence lock changed since the
+ * transaction's snapshot, the transaction re-reads its read log and
+ * restarts if any value differs.
+ *
+ * Privatizing memory acquires the sequence lock until the end of the
+ * transaction, so other transactions wait for it.
+ */
+
+#include "tm-norec.h"
+#include "conflict.h"
+#include "fault.h"
+#include "thread.h"
+#include "tm-engine.h"
+#include "trace.h"
+
+uint64_t g_norec_seq;
+
+__thread uint64_t t_norec_snapshot;
+
+__thread struct stripe* t_norec_read;
+__thread unsigned long  t_norec_nreads;
+__thread unsigned long  t_norec_readcap;
+
+/* Undo log of privatized stores */
+static __thread struct stripe* t_undo;
+static __thread unsigned long  t_nundos;
+static __thread unsigned long  t_undocap;
+
+static struct stripe*
+append_undo(uintptr_t base)
+{
+    if (t_nundos == t_undocap) {
+        t_undo = arraygrow(t_undo, &t_undocap, sizeof(*t_undo));
+    }
+
+    struct stripe* stripe = t_undo + t_nundos;
+    stripe_init(stripe, base);
+
+    ++t_nundos;
+
+    return stripe;
+}
+
+static uint64_t
+wait_for_even_seq(void)
+{
+    uint64_t seq = __atomic_load_n(&g_norec_seq, __ATOMIC_ACQUIRE);
+
+    while (seq & 1) {
+        cpu_relax();
+        seq = __atomic_load_n(&g_norec_seq, __ATOMIC_ACQUIRE);
+    }
+
+    return seq;
+}
+
+/* Returns the first entry of the read log with changed values,
+ * or NULL if all bytes still hold their values. */
+static const struct stripe*
+find_invalid_read(void)
+{
+    const struct stripe* beg = t_norec_read;
+    const struct stripe* end = t_norec_read + t_norec_nreads;
+
+    while (beg < end) {
+        if (!equal_masked((const void*)beg->base, beg->value,
+                          beg->bits, arraylen(beg->bits), 0, STRIPE_NBYTES)) {
+            return beg;
+        }
+        ++beg;
+    }
+
+    return NULL;
+}
+
+void
+_tm_norec_validate(void)
+{
+    while (true) {
+        uint64_t seq = wait_for_even_seq();
+
+        const struct stripe* invalid = find_invalid_read();
+        if (invalid) {
+            conflict_record(invalid->base, CONFLICT_NO_SLOT, 0);
+            trace_record(TRACE_CONFLICT, invalid->base, 0);
+            _tm_restart(TM_ABORT_CONFLICT);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&g_norec_seq, __ATOMIC_RELAXED) == seq) {
+            t_norec_snapshot = seq;
+            return;
+        }
+    }
+}
+
+static void
+acquire_lock(void)
+{
+    if (norec_holds_lock()) {
+        return;
+    }
+
+    if (fault_inject(FAULT_ACQUIRE)) {
+        _tm_restart(TM_ABORT_CONFLICT);
+    }
+
+    uint64_t expected = t_norec_snapshot;
+
+    while (!__atomic_compare_exchange_n(&g_norec_seq, &expected,
+                                        t_norec_snapshot + 1, false,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+        _tm_norec_validate();
+        expected = t_norec_snapshot;
+    }
+
+    ++t_norec_snapshot;
+
+    trace_record(TRACE_ACQUIRE, 0, 0);
+}
+
+static void
+release_lock(void)
+{
+    if (!norec_holds_lock()) {
+        return;
+    }
+
+    ++t_norec_snapshot;
+
+    __atomic_store_n(&g_norec_seq, t_norec_snapshot, __ATOMIC_RELEASE);
+}
+
+/*
+ * Engine interface
+ */
+
+void
+_tm_engine_begin(struct _tm_tx* tx)
+{
+    t_norec_snapshot = wait_for_even_seq();
+}
+
+void
+_tm_engine_commit(struct _tm_tx* tx)
+{
+    struct stripe* beg = redo_beg();
+    struct stripe* end = redo_end();
+
+    struct tm_stats* stats = _tm_thread_stats();
+
+    if (beg != end) {
+        acquire_lock();
+
+        size_t nstored = 0;
+        unsigned long nstripes = end - beg;
+
+        while (beg < end) {
+            stripe_store(beg);
+            nstored += bitmask_count(beg->bits, arraylen(beg->bits));
+            ++beg;
+        }
+
+        stats->written_bytes += nstored;
+
+        trace_record(TRACE_WRITE_BACK, nstored, nstripes);
+    }
+
+    if (norec_holds_lock()) {
+        ++stats->acquired;
+    }
+
+    release_lock();
+
+    t_norec_nreads = 0;
+    t_nundos = 0;
+    redo_clear();
+}
+
+void
+_tm_engine_rollback(struct _tm_tx* tx)
+{
+    /* Revert privatized stores, most recent first. */
+    while (t_nundos) {
+        --t_nundos;
+        stripe_store(t_undo + t_nundos);
+    }
+
+    release_lock();
+
+    t_norec_nreads = 0;
+    redo_clear();
+}
+
+void
+privatize(uintptr_t addr, size_t siz, bool load, bool store)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    acquire_lock();
+
+    while (store && siz) {
+
+        unsigned long index = addr & STRIPE_BITMASK;
+        size_t len = min_size(siz, STRIPE_NBYTES - index);
+
+        /* If we're about to store, we first have to
+         * save the old value for possible rollbacks. */
+        struct stripe* undo = append_undo(addr & ~STRIPE_BITMASK);
+        copy_bytes(undo->value + index, (const void*)addr, len);
+        bitmask_set_range(undo->bits, index, len);
+
+        siz -= len;
+        addr += len;
+    }
+}
+
+void
+load(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    uint8_t* mem = (uint8_t*)buf;
+
+    while (siz) {
+
+        size_t len = min_size(siz, STRIPE_NBYTES - (addr & STRIPE_BITMASK));
+
+        _tm_load_slot(addr, mem, len);
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+void
+store(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    redo_store(addr, buf, siz);
+}
+
+void
+tm_load_range(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    memcpy(buf, (const void*)addr, siz);
+
+    if (!norec_holds_lock()) {
+
+        /* Log the bytes that came from memory. */
+        const uint8_t* mem = (const uint8_t*)buf;
+        uintptr_t beg = addr;
+        size_t len = siz;
+
+        while (len) {
+
+            uintptr_t base = beg & ~STRIPE_BITMASK;
+            unsigned long index = beg & STRIPE_BITMASK;
+            size_t stripe_len = min_size(len, STRIPE_NBYTES - index);
+
+            struct stripe* read = norec_append_read(base);
+            copy_bytes(read->value + index, mem, stripe_len);
+            bitmask_set_range(read->bits, index, stripe_len);
+
+            const struct stripe* redo = redo_find(base);
+            if (redo) {
+                bitmask_andnot(read->bits, redo->bits, arraylen(read->bits));
+            }
+
+            len -= stripe_len;
+            beg += stripe_len;
+            mem += stripe_len;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&g_norec_seq, __ATOMIC_RELAXED) != t_norec_snapshot) {
+            _tm_norec_validate();
+        }
+    }
+
+    redo_blend(addr, buf, siz);
+}
+
+void
+tm_store_range(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    redo_store(addr, buf, siz);
+}
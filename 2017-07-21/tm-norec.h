@@ -0,0 +1,106 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include "tm.h"
+#include "array.h"
+#include "blend.h"
+#include "redo.h"
+
+/*
+ * Single-granule accesses of the NOrec engine
+ */
+
+#define TM_GRANULE_NBYTES   STRIPE_NBYTES
+
+extern uint64_t g_norec_seq;
+
+/* Snapshot of the sequence lock, odd if we hold the lock */
+extern __thread uint64_t t_norec_snapshot;
+
+/* Read log */
+extern __thread struct stripe* t_norec_read;
+extern __thread unsigned long  t_norec_nreads;
+extern __thread unsigned long  t_norec_readcap;
+
+/* Moves the snapshot to the current sequence number, or restarts
+ * the transaction if its reads are no longer consistent. */
+void
+_tm_norec_validate(void);
+
+static inline bool
+norec_holds_lock(void)
+{
+    return !!(t_norec_snapshot & 1);
+}
+
+static inline struct stripe*
+norec_append_read(uintptr_t base)
+{
+    if (t_norec_nreads == t_norec_readcap) {
+        t_norec_read = arraygrow(t_norec_read, &t_norec_readcap,
+                                 sizeof(*t_norec_read));
+    }
+
+    struct stripe* stripe = t_norec_read + t_norec_nreads;
+    stripe_init(stripe, base);
+
+    ++t_norec_nreads;
+
+    return stripe;
+}
+
+/* Loads siz bytes at addr, which must not cross a granule. */
+static inline void
+_tm_load_slot(uintptr_t addr, void* buf, size_t siz)
+{
+    uintptr_t base = addr & ~STRIPE_BITMASK;
+
+    unsigned long index = addr & STRIPE_BITMASK;
+
+    const struct stripe* redo = redo_find(base);
+
+    copy_bytes(buf, (const void*)addr, siz);
+
+    /* While we hold the lock, memory cannot change. */
+    if (!norec_holds_lock()) {
+
+        /* Log the bytes that came from memory. */
+        struct stripe* read = norec_append_read(base);
+        copy_bytes(read->value + index, buf, siz);
+        bitmask_set_range(read->bits, index, siz);
+        if (redo) {
+            bitmask_andnot(read->bits, redo->bits, arraylen(read->bits));
+        }
+
+        /* Our reads are consistent, unless another transaction
+         * committed since our snapshot. Validation then re-checks
+         * the read log, including the values we just read. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&g_norec_seq, __ATOMIC_RELAXED) != t_norec_snapshot) {
+            _tm_norec_validate();
+        }
+    }
+
+    if (redo) {
+        blend_bytes(buf, redo->value + index,
+                    redo->bits, arraylen(redo->bits), index, siz);
+    }
+}
+
+/* Stores siz bytes at addr, which must not cross a granule. */
+static inline void
+_tm_store_slot(uintptr_t addr, const void* buf, size_t siz)
+{
+    redo_store(addr, buf, siz);
+}
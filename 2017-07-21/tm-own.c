@@ -0,0 +1,210 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Ownership-table engine
+ *
+ * Each transaction acquires exclusive ownership of every resource
+ * it accesses. Stores are buffered in the resource and written back
+ * on commit.
+ */
+
+#include "tm-own.h"
+#include "array.h"
+#include "conflict.h"
+#include "tm-engine.h"
+#include "trace.h"
+
+void
+_tm_engine_begin(struct _tm_tx* tx)
+{
+    /* Nothing to do */
+}
+
+void
+_tm_engine_commit(struct _tm_tx* tx)
+{
+    struct tm_stats* stats = _tm_thread_stats();
+
+    unsigned long nacquired = acquired_resources();
+    size_t nstored = release_resources(true);
+
+    stats->acquired += nacquired;
+    stats->written_bytes += nstored;
+
+    trace_record(TRACE_WRITE_BACK, nstored, nacquired);
+}
+
+void
+_tm_engine_rollback(struct _tm_tx* tx)
+{
+    release_resources(false);
+}
+
+void
+privatize(uintptr_t addr, size_t siz, bool load, bool store)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    while (siz) {
+
+        struct resource* res = _tm_own_acquire(addr & BASE_BITMASK);
+
+        unsigned long index = addr & RESOURCE_BITMASK;
+        size_t len = min_size(siz, RESOURCE_NBYTES - index);
+
+        if (store) {
+            /* If we're about to store, we first have to
+             * save the old value for possible rollbacks. */
+            uint64_t clean_bits[arraylen(res->local_bits)];
+            bitmask_not(clean_bits, res->local_bits, arraylen(clean_bits));
+
+            blend_bytes(res->local_value + index, (const void*)addr,
+                        clean_bits, arraylen(clean_bits), index, len);
+
+            resource_or_flags(res, RESOURCE_FLAG_WRITE_THROUGH);
+        }
+
+        siz -= len;
+        addr += len;
+    }
+}
+
+void
+load(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    uint8_t* mem = (uint8_t*)buf;
+
+    while (siz) {
+
+        size_t len = min_size(siz, RESOURCE_NBYTES - (addr & RESOURCE_BITMASK));
+
+        _tm_load_slot(addr, mem, len);
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+void
+store(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    const uint8_t* mem = (const uint8_t*)buf;
+
+    while (siz) {
+
+        size_t len = min_size(siz, RESOURCE_NBYTES - (addr & RESOURCE_BITMASK));
+
+        _tm_store_slot(addr, mem, len);
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+/* Acquires the resources for up to TM_RANGE_NGRANULES granules at addr.
+ * Returns the number of covered bytes. */
+static size_t
+acquire_range(uintptr_t addr, size_t siz, struct resource** res,
+              unsigned long* nres)
+{
+    size_t len = 0;
+
+    for (*nres = 0; (len < siz) && (*nres < TM_RANGE_NGRANULES); ++*nres) {
+
+        uintptr_t beg = addr + len;
+
+        res[*nres] = _tm_own_acquire(beg & BASE_BITMASK);
+
+        len += min_size(siz - len, RESOURCE_NBYTES - (beg & RESOURCE_BITMASK));
+    }
+
+    return len;
+}
+
+void
+tm_load_range(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    uint8_t* mem = (uint8_t*)buf;
+
+    while (siz) {
+
+        struct resource* res[TM_RANGE_NGRANULES];
+        unsigned long nres;
+
+        size_t len = acquire_range(addr, siz, res, &nres);
+
+        memcpy(mem, (const void*)addr, len);
+
+        /* Merge our own stores into the copy. */
+        unsigned long i;
+        for (i = 0; i < nres; ++i) {
+
+            if (bitmask_is_empty(res[i]->local_bits,
+                                 arraylen(res[i]->local_bits))) {
+                continue;
+            }
+
+            uintptr_t beg = res[i]->base > addr ? res[i]->base : addr;
+            uintptr_t end = res[i]->base + RESOURCE_NBYTES < addr + len ?
+                                res[i]->base + RESOURCE_NBYTES : addr + len;
+
+            unsigned long index = beg - res[i]->base;
+
+            blend_bytes(mem + (beg - addr), res[i]->local_value + index,
+                        res[i]->local_bits, arraylen(res[i]->local_bits),
+                        index, end - beg);
+        }
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+void
+tm_store_range(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    const uint8_t* mem = (const uint8_t*)buf;
+
+    while (siz) {
+
+        struct resource* res[TM_RANGE_NGRANULES];
+        unsigned long nres;
+
+        size_t len = acquire_range(addr, siz, res, &nres);
+
+        unsigned long i;
+        for (i = 0; i < nres; ++i) {
+
+            unsigned long index = addr & RESOURCE_BITMASK;
+            size_t granule_len = min_size(len, RESOURCE_NBYTES - index);
+
+            memcpy(res[i]->local_value + index, mem, granule_len);
+            bitmask_set_range(res[i]->local_bits, index, granule_len);
+
+            len -= granule_len;
+            siz -= granule_len;
+            addr += granule_len;
+            mem += granule_len;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include "tm.h"
+#include "array.h"
+#include "blend.h"
+#include "fault.h"
+#include "res.h"
+
+/*
+ * Single-granule accesses of the ownership-table engine
+ */
+
+#define TM_GRANULE_NBYTES   RESOURCE_NBYTES
+
+/* Returns the resource for base, or restarts the transaction if
+ * another thread owns it or the table was resized. */
+static inline struct resource*
+_tm_own_acquire(uintptr_t base)
+{
+    struct resource* res = find_acquired_resource(base);
+
+    if (__builtin_expect(!res, 0)) {
+        res = fault_inject(FAULT_ACQUIRE) ? NULL : acquire_resource(base);
+        if (!res) {
+            _tm_restart(resource_table_resized() ? TM_ABORT_ALIAS
+                                                 : TM_ABORT_CONFLICT);
+        }
+    }
+
+    return res;
+}
+
+/* Loads siz bytes at addr, which must not cross a granule. */
+static inline void
+_tm_load_slot(uintptr_t addr, void* buf, size_t siz)
+{
+    struct resource* res = _tm_own_acquire(addr & BASE_BITMASK);
+
+    unsigned long index = addr & RESOURCE_BITMASK;
+
+    copy_bytes(buf, (const void*)addr, siz);
+    blend_bytes(buf, res->local_value + index,
+                res->local_bits, arraylen(res->local_bits), index, siz);
+}
+
+/* Stores siz bytes at addr, which must not cross a granule. */
+static inline void
+_tm_store_slot(uintptr_t addr, const void* buf, size_t siz)
+{
+    struct resource* res = _tm_own_acquire(addr & BASE_BITMASK);
+
+    unsigned long index = addr & RESOURCE_BITMASK;
+
+    copy_bytes(res->local_value + index, buf, siz);
+    bitmask_set_range(res->local_bits, index, siz);
+}
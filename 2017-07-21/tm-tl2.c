@@ -0,0 +1,343 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * TL2 engine
+ *
+ * Memory is divided into stripes, each of which hashes to a versioned
+ * lock. Loads are invisible: they only check that the stripe's lock
+ * is free and not newer than the transaction's read version, and
+ * remember the lock in the read set. Stores go to a redo log. On
+ * commit, the transaction locks the stripes in its redo log, takes a
+ * new version from the global clock, validates its read set and
+ * writes back the redo log.
+ */
+
+#include "tm-tl2.h"
+#include "conflict.h"
+#include "fault.h"
+#include "tm-engine.h"
+#include "trace.h"
+
+/**
+ * A lock held by a transaction and the version it replaced.
+ */
+struct tl2_held {
+    uint64_t* lock;
+    uint64_t  version;
+};
+
+static uint64_t g_tl2_clock;
+uint64_t        g_tl2_lock[TL2_NLOCKS];
+
+__thread uint64_t t_tl2_rv;
+
+__thread uint64_t**    t_tl2_read;
+__thread unsigned long t_tl2_nreads;
+__thread unsigned long t_tl2_readcap;
+
+/* Locks held by the current transaction */
+static __thread struct tl2_held*  t_held;
+static __thread unsigned long     t_nheld;
+static __thread unsigned long     t_heldcap;
+
+/* Undo log of privatized stores */
+static __thread struct stripe*    t_undo;
+static __thread unsigned long     t_nundos;
+static __thread unsigned long     t_undocap;
+
+/*
+ * Held locks and undo log of privatized stores
+ */
+
+static void
+append_held(uint64_t* lock, uint64_t version)
+{
+    if (t_nheld == t_heldcap) {
+        t_held = arraygrow(t_held, &t_heldcap, sizeof(*t_held));
+    }
+    t_held[t_nheld].lock = lock;
+    t_held[t_nheld].version = version;
+    ++t_nheld;
+}
+
+static struct stripe*
+append_undo(uintptr_t base)
+{
+    if (t_nundos == t_undocap) {
+        t_undo = arraygrow(t_undo, &t_undocap, sizeof(*t_undo));
+    }
+
+    struct stripe* stripe = t_undo + t_nundos;
+    stripe_init(stripe, base);
+
+    ++t_nundos;
+
+    return stripe;
+}
+
+/* Acquires the lock of a stripe for the current transaction, or
+ * restarts the transaction if that's not possible. */
+static void
+acquire_lock(uintptr_t base, uint64_t self)
+{
+    uint64_t* lock = tl2_find_lock(base);
+
+    uint64_t version = __atomic_load_n(lock, __ATOMIC_RELAXED);
+
+    if (version == self) {
+        return; /* Held by us. */
+    }
+
+    /* The lock has to be free and not newer than our snapshot; we
+     * might have read from one of its stripes. */
+    if (fault_inject(FAULT_ACQUIRE)) {
+        _tm_restart(TM_ABORT_CONFLICT);
+    } else if ((version & TL2_LOCKED) || ((version >> 1) > t_tl2_rv)) {
+        tl2_conflict(base, lock, version);
+    }
+
+    bool locked = __atomic_compare_exchange_n(lock, &version, self, false,
+                                              __ATOMIC_ACQUIRE,
+                                              __ATOMIC_RELAXED);
+    if (!locked) {
+        tl2_conflict(base, lock, version);
+    }
+
+    append_held(lock, version);
+
+    trace_record(TRACE_ACQUIRE, base, lock - g_tl2_lock);
+}
+
+/* Releases all held locks with the given commit version, or
+ * restores their previous versions if the version is 0. */
+static void
+release_locks(uint64_t version)
+{
+    struct tl2_held* beg = t_held;
+    struct tl2_held* end = t_held + t_nheld;
+
+    while (beg < end) {
+        uint64_t value = version ? version << 1 : beg->version;
+        __atomic_store_n(beg->lock, value, __ATOMIC_RELEASE);
+        ++beg;
+    }
+
+    t_nheld = 0;
+}
+
+/*
+ * Engine interface
+ */
+
+void
+_tm_engine_begin(struct _tm_tx* tx)
+{
+    t_tl2_rv = __atomic_load_n(&g_tl2_clock, __ATOMIC_ACQUIRE);
+}
+
+void
+_tm_engine_commit(struct _tm_tx* tx)
+{
+    struct stripe* beg = redo_beg();
+    struct stripe* end = redo_end();
+
+    if ((beg == end) && !t_nheld) {
+        /* Read-only transactions are consistent at any time. */
+        t_tl2_nreads = 0;
+        return;
+    }
+
+    uint64_t self = tl2_locked_by_self();
+
+    struct stripe* redo;
+
+    for (redo = beg; redo < end; ++redo) {
+        acquire_lock(redo->base, self);
+    }
+
+    uint64_t wv = __atomic_add_fetch(&g_tl2_clock, 1, __ATOMIC_ACQ_REL);
+
+    if (wv != t_tl2_rv + 1) {
+        /* Another transaction committed since we started. */
+        uint64_t** read = t_tl2_read;
+        uint64_t** read_end = t_tl2_read + t_tl2_nreads;
+
+        while (read < read_end) {
+            uint64_t version = __atomic_load_n(*read, __ATOMIC_ACQUIRE);
+            if ((version != self) &&
+                ((version & TL2_LOCKED) || ((version >> 1) > t_tl2_rv))) {
+                tl2_conflict(0, *read, version);
+            }
+            ++read;
+        }
+    }
+
+    struct tm_stats* stats = _tm_thread_stats();
+
+    size_t nstored = 0;
+
+    for (redo = beg; redo < end; ++redo) {
+        stripe_store(redo);
+        nstored += bitmask_count(redo->bits, arraylen(redo->bits));
+    }
+
+    stats->acquired += t_nheld;
+    stats->written_bytes += nstored;
+
+    trace_record(TRACE_WRITE_BACK, nstored, t_nheld);
+
+    release_locks(wv);
+
+    t_tl2_nreads = 0;
+    t_nundos = 0;
+    redo_clear();
+}
+
+void
+_tm_engine_rollback(struct _tm_tx* tx)
+{
+    /* Revert privatized stores, most recent first. */
+    while (t_nundos) {
+        --t_nundos;
+        stripe_store(t_undo + t_nundos);
+    }
+
+    release_locks(0);
+
+    t_tl2_nreads = 0;
+    redo_clear();
+}
+
+void
+privatize(uintptr_t addr, size_t siz, bool load, bool store)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    uint64_t self = tl2_locked_by_self();
+
+    while (siz) {
+
+        uintptr_t base = addr & ~STRIPE_BITMASK;
+
+        acquire_lock(base, self);
+
+        unsigned long index = addr & STRIPE_BITMASK;
+        size_t len = min_size(siz, STRIPE_NBYTES - index);
+
+        if (store) {
+            /* If we're about to store, we first have to
+             * save the old value for possible rollbacks. */
+            struct stripe* undo = append_undo(base);
+            copy_bytes(undo->value + index, (const void*)addr, len);
+            bitmask_set_range(undo->bits, index, len);
+        }
+
+        siz -= len;
+        addr += len;
+    }
+}
+
+void
+load(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    uint8_t* mem = (uint8_t*)buf;
+
+    while (siz) {
+
+        size_t len = min_size(siz, STRIPE_NBYTES - (addr & STRIPE_BITMASK));
+
+        _tm_load_slot(addr, mem, len);
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+void
+store(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    redo_store(addr, buf, siz);
+}
+
+void
+tm_load_range(uintptr_t addr, void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    uint8_t* mem = (uint8_t*)buf;
+
+    uint64_t self = tl2_locked_by_self();
+
+    while (siz) {
+
+        uint64_t* lock[TM_RANGE_NGRANULES];
+        uint64_t version[TM_RANGE_NGRANULES];
+        unsigned long nlocks;
+
+        /* Check the locks of up to TM_RANGE_NGRANULES stripes... */
+        size_t len = 0;
+
+        for (nlocks = 0; (len < siz) && (nlocks < TM_RANGE_NGRANULES); ++nlocks) {
+
+            uintptr_t beg = addr + len;
+
+            lock[nlocks] = tl2_find_lock(beg & ~STRIPE_BITMASK);
+            version[nlocks] = __atomic_load_n(lock[nlocks], __ATOMIC_ACQUIRE);
+
+            if ((version[nlocks] != self) &&
+                ((version[nlocks] & TL2_LOCKED) ||
+                 ((version[nlocks] >> 1) > t_tl2_rv))) {
+                tl2_conflict(beg & ~STRIPE_BITMASK, lock[nlocks], version[nlocks]);
+            }
+
+            len += min_size(siz - len, STRIPE_NBYTES - (beg & STRIPE_BITMASK));
+        }
+
+        /* ...copy them at once... */
+        memcpy(mem, (const void*)addr, len);
+
+        /* ...and verify that none changed meanwhile. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        unsigned long i;
+        for (i = 0; i < nlocks; ++i) {
+            if (version[i] == self) {
+                continue;
+            }
+            uint64_t current = __atomic_load_n(lock[i], __ATOMIC_RELAXED);
+            if (current != version[i]) {
+                tl2_conflict((addr & ~STRIPE_BITMASK) + i * STRIPE_NBYTES,
+                             lock[i], current);
+            }
+            tl2_append_read(lock[i]);
+        }
+
+        redo_blend(addr, mem, len);
+
+        siz -= len;
+        addr += len;
+        mem += len;
+    }
+}
+
+void
+tm_store_range(uintptr_t addr, const void* buf, size_t siz)
+{
+    conflict_set_site(__builtin_return_address(0));
+
+    redo_store(addr, buf, siz);
+}
@@ -0,0 +1,125 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include "tm.h"
+#include "array.h"
+#include "blend.h"
+#include "conflict.h"
+#include "redo.h"
+#include "thread.h"
+#include "trace.h"
+
+/*
+ * Single-granule accesses of the TL2 engine
+ */
+
+#define TM_GRANULE_NBYTES   STRIPE_NBYTES
+
+#define TL2_NLOCKS_BITSHIFT (16)
+#define TL2_NLOCKS          (1ul << TL2_NLOCKS_BITSHIFT)
+#define TL2_NLOCKS_BITMASK  ((1ul << TL2_NLOCKS_BITSHIFT) - 1)
+
+/* An unlocked lock contains the version of the most recent commit
+ * to its stripes, shifted left by one. A locked lock contains the
+ * owner's thread id, shifted left by one, and the locked bit. */
+#define TL2_LOCKED          (1ul)
+
+extern uint64_t g_tl2_lock[TL2_NLOCKS];
+
+/* Read version of the current transaction */
+extern __thread uint64_t t_tl2_rv;
+
+/* Read set */
+extern __thread uint64_t**    t_tl2_read;
+extern __thread unsigned long t_tl2_nreads;
+extern __thread unsigned long t_tl2_readcap;
+
+static inline uint64_t*
+tl2_find_lock(uintptr_t base)
+{
+    unsigned long element = (base >> STRIPE_BITSHIFT) & TL2_NLOCKS_BITMASK;
+
+    return g_tl2_lock + element;
+}
+
+static inline uint64_t
+tl2_locked_by_self(void)
+{
+    return ((uint64_t)thread_id() << 1) | TL2_LOCKED;
+}
+
+static inline void
+tl2_append_read(uint64_t* lock)
+{
+    if (t_tl2_nreads == t_tl2_readcap) {
+        t_tl2_read = arraygrow(t_tl2_read, &t_tl2_readcap, sizeof(*t_tl2_read));
+    }
+    t_tl2_read[t_tl2_nreads] = lock;
+    ++t_tl2_nreads;
+}
+
+/* Restarts the transaction after a conflict on the lock of the
+ * stripe at base, which is 0 if unknown. */
+static inline void
+tl2_conflict(uintptr_t base, const uint64_t* lock, uint64_t version)
+{
+    uint64_t owner = (version & TL2_LOCKED) ? version >> 1 : 0;
+
+    conflict_record(base, lock - g_tl2_lock, owner);
+    trace_record(TRACE_CONFLICT, base, owner);
+    _tm_restart(TM_ABORT_CONFLICT);
+}
+
+/* Loads siz bytes at addr, which must not cross a granule. */
+static inline void
+_tm_load_slot(uintptr_t addr, void* buf, size_t siz)
+{
+    uintptr_t base = addr & ~STRIPE_BITMASK;
+
+    uint64_t self = tl2_locked_by_self();
+
+    uint64_t* lock = tl2_find_lock(base);
+
+    uint64_t version = __atomic_load_n(lock, __ATOMIC_ACQUIRE);
+
+    if ((version != self) &&
+        ((version & TL2_LOCKED) || ((version >> 1) > t_tl2_rv))) {
+        tl2_conflict(base, lock, version);
+    }
+
+    copy_bytes(buf, (const void*)addr, siz);
+
+    if (version != self) {
+        /* The stripe must not have changed while we read it. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint64_t current = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        if (current != version) {
+            tl2_conflict(base, lock, current);
+        }
+        tl2_append_read(lock);
+    }
+
+    const struct stripe* redo = redo_find(base);
+    if (redo) {
+        unsigned long index = addr & STRIPE_BITMASK;
+        blend_bytes(buf, redo->value + index,
+                    redo->bits, arraylen(redo->bits), index, siz);
+    }
+}
+
+/* Stores siz bytes at addr, which must not cross a granule. */
+static inline void
+_tm_store_slot(uintptr_t addr, const void* buf, size_t siz)
+{
+    redo_store(addr, buf, siz);
+}
@@ -10,123 +10,325 @@
  */
 
 #include "tm.h"
-#include <assert.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "array.h"
-#include "res.h"
+#include "conflict.h"
+#include "epoch.h"
+#include "fault.h"
+#include "histogram.h"
+#include "thread.h"
+#include "tm-engine.h"
+#include "trace.h"
+#include "tsc.h"
+
+/* Maximum number of log entries per transaction; override with
+ * -DTM_LOG_MAX_NENTRIES. */
+#ifndef TM_LOG_MAX_NENTRIES
+#define TM_LOG_MAX_NENTRIES     (1ul << 20)
+#endif
+
+/* Maximum number of allocated chunks a thread keeps between
+ * transactions */
+#define TM_LOG_NPOOLED_CHUNKS   (16)
+
+/* Maximum number of sites with statistics; override with
+ * -DTM_NSITES. Further sites share the first entry. */
+#ifndef TM_NSITES
+#define TM_NSITES               (128)
+#endif
+
+/* Per-thread statistics, each on its own cache line */
+static struct {
+    struct tm_stats   stats;
+    /* TM_NSITES statistics, allocated on first use */
+    struct tm_stats*  site_stats;
+    /* TM_NHISTOGRAMS histograms, allocated on first use */
+    struct histogram* hist;
+} __attribute__((aligned(64))) g_tm_thread[NTHREADS];
+
+/* Sites by statistics index; the first entry is for sites beyond
+ * TM_NSITES. */
+static const struct tm_site* g_tm_site[TM_NSITES];
+static unsigned long         g_tm_nsites = 1;
+
+struct tm_stats*
+_tm_thread_stats()
+{
+    return &g_tm_thread[thread_id()].stats;
+}
 
-void
-privatize(uintptr_t addr, size_t siz, bool load, bool store)
+static struct histogram*
+thread_histograms(void)
 {
-    while (siz) {
+    struct histogram** hist = &g_tm_thread[thread_id()].hist;
+
+    if (__builtin_expect(!*hist, 0)) {
+        struct histogram* new_hist = calloc(TM_NHISTOGRAMS, sizeof(*new_hist));
+        if (!new_hist) {
+            perror("calloc");
+            abort(); /* We cannot record; let's abort for now. */
+        }
+        __atomic_store_n(hist, new_hist, __ATOMIC_RELEASE);
+    }
+
+    return *hist;
+}
 
-        struct resource* res = acquire_resource(addr & BASE_BITMASK);
-        if (!res) {
-            tm_restart();
+void
+tm_histogram_snapshot(enum tm_histogram which, struct histogram* hist)
+{
+    memset(hist, 0, sizeof(*hist));
+
+    unsigned long i;
+    for (i = 0; i < arraylen(g_tm_thread); ++i) {
+        const struct histogram* thread_hist =
+            __atomic_load_n(&g_tm_thread[i].hist, __ATOMIC_ACQUIRE);
+        if (thread_hist) {
+            histogram_merge(hist, thread_hist + which);
         }
+    }
+}
 
-        unsigned long index = addr & RESOURCE_BITMASK;
-        unsigned long bits = 1ul << index;
+void
+tm_histogram_percentiles(enum tm_histogram which,
+                         struct tm_percentiles* percentiles)
+{
+    struct histogram* hist = malloc(sizeof(*hist));
+    if (!hist) {
+        perror("malloc");
+        abort(); /* We cannot merge; let's abort for now. */
+    }
 
-        uint8_t* beg = arraybeg(res->local_value) + index;
-        uint8_t* end = arrayend(res->local_value);
+    tm_histogram_snapshot(which, hist);
 
-        while (siz && (beg < end)) {
-            /* If we're about to store, we first have to
-             * save the old value for possible rollbacks. */
-            if (store && !(res->local_bits & bits) ) {
-                *beg = *((uint8_t*)addr);
-            }
+    /* Latencies are in timestamp ticks. */
+    double scale = which == TM_HIST_RETRIES ? 1 : 1 / tsc_ticks_per_ns();
 
-            bits <<= 1;
-            --siz;
-            ++addr;
-            ++beg;
-        }
+    percentiles->count = hist->total;
+    percentiles->p50   = histogram_percentile(hist, 0.5) * scale;
+    percentiles->p99   = histogram_percentile(hist, 0.99) * scale;
+    percentiles->p999  = histogram_percentile(hist, 0.999) * scale;
+    percentiles->max   = hist->max * scale;
 
-        if (store) {
-            res->flags |= RESOURCE_FLAG_WRITE_THROUGH;
-        }
+    free(hist);
+}
+
+/* Adds a thread's statistics to stats. */
+static void
+add_stats(struct tm_stats* stats, const struct tm_stats* thread_stats)
+{
+    stats->commits += __atomic_load_n(&thread_stats->commits, __ATOMIC_RELAXED);
+
+    unsigned long reason;
+    for (reason = 0; reason < TM_NABORT_REASONS; ++reason) {
+        stats->aborts[reason] +=
+            __atomic_load_n(thread_stats->aborts + reason, __ATOMIC_RELAXED);
+    }
+
+    unsigned long max_retries =
+        __atomic_load_n(&thread_stats->max_retries, __ATOMIC_RELAXED);
+    if (max_retries > stats->max_retries) {
+        stats->max_retries = max_retries;
     }
+
+    stats->acquired      += __atomic_load_n(&thread_stats->acquired, __ATOMIC_RELAXED);
+    stats->log_entries   += __atomic_load_n(&thread_stats->log_entries, __ATOMIC_RELAXED);
+    stats->written_bytes += __atomic_load_n(&thread_stats->written_bytes, __ATOMIC_RELAXED);
 }
 
 void
-load(uintptr_t addr, void* buf, size_t siz)
+tm_stats_snapshot(struct tm_stats* stats)
 {
-    uint8_t* mem = (uint8_t*)buf;
+    memset(stats, 0, sizeof(*stats));
 
-    while (siz) {
+    unsigned long i;
+    for (i = 0; i < arraylen(g_tm_thread); ++i) {
+        add_stats(stats, &g_tm_thread[i].stats);
+    }
+}
 
-        struct resource* res = acquire_resource(addr & BASE_BITMASK);
-        if (!res) {
-            tm_restart();
-        }
+/* Returns the statistics index of a site, and assigns one on
+ * the site's first use. */
+static unsigned long
+site_index(struct tm_site* site)
+{
+    if (!site) {
+        return 0;
+    }
 
-        unsigned long index = addr & RESOURCE_BITMASK;
-        unsigned long bits = 1ul << index;
+    unsigned long index = __atomic_load_n(&site->index, __ATOMIC_ACQUIRE);
 
-        uint8_t* beg = arraybeg(res->local_value) + index;
-        uint8_t* end = arrayend(res->local_value);
+    if (__builtin_expect(!index, 0)) {
 
-        while (siz && (beg < end)) {
-            if (res->local_bits & bits) {
-                *mem = *beg;
-            } else {
-                *mem = *((uint8_t*)addr);
+        unsigned long new_index =
+            __atomic_fetch_add(&g_tm_nsites, 1, __ATOMIC_RELAXED);
+        if (new_index >= TM_NSITES) {
+            new_index = 0;
+        }
+
+        if (__atomic_compare_exchange_n(&site->index, &index, new_index + 1,
+                                        false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            if (new_index) {
+                __atomic_store_n(g_tm_site + new_index, site, __ATOMIC_RELEASE);
             }
+            index = new_index + 1;
+        }
+        /* Otherwise, another thread registered the site first and
+         * our entry remains unused. */
+    }
 
-            bits <<= 1;
-            --siz;
-            ++addr;
-            ++mem;
-            ++beg;
+    return index - 1;
+}
+
+static struct tm_stats*
+thread_site_stats(struct tm_site* site)
+{
+    struct tm_stats** site_stats = &g_tm_thread[thread_id()].site_stats;
+
+    if (__builtin_expect(!*site_stats, 0)) {
+        struct tm_stats* new_stats = calloc(TM_NSITES, sizeof(*new_stats));
+        if (!new_stats) {
+            perror("calloc");
+            abort(); /* We cannot record; let's abort for now. */
         }
+        __atomic_store_n(site_stats, new_stats, __ATOMIC_RELEASE);
     }
+
+    return *site_stats + site_index(site);
 }
 
 void
-store(uintptr_t addr, const void* buf, size_t siz)
+tm_site_stats_snapshot(const struct tm_site* site, struct tm_stats* stats)
 {
-    const uint8_t* mem = (const uint8_t*)buf;
+    memset(stats, 0, sizeof(*stats));
 
-    while (siz) {
+    unsigned long index = __atomic_load_n(&site->index, __ATOMIC_ACQUIRE);
+    if (!index) {
+        return;
+    }
 
-        struct resource* res = acquire_resource(addr & BASE_BITMASK);
-        if (!res) {
-            tm_restart();
+    unsigned long i;
+    for (i = 0; i < arraylen(g_tm_thread); ++i) {
+        const struct tm_stats* site_stats =
+            __atomic_load_n(&g_tm_thread[i].site_stats, __ATOMIC_ACQUIRE);
+        if (site_stats) {
+            add_stats(stats, site_stats + index - 1);
         }
+    }
+}
 
-        unsigned long index = addr & RESOURCE_BITMASK;
-        unsigned long bits = 1ul << index;
-
-        uint8_t* beg = arraybeg(res->local_value) + index;
-        uint8_t* end = arrayend(res->local_value);
+unsigned long
+tm_sites(const struct tm_site** site, unsigned long n)
+{
+    unsigned long nsites = __atomic_load_n(&g_tm_nsites, __ATOMIC_RELAXED);
+    if (nsites > TM_NSITES) {
+        nsites = TM_NSITES;
+    }
 
-        while (siz && (beg < end)) {
-            *beg = *mem;
-            res->local_bits |= bits;
+    unsigned long count = 0;
 
-            bits <<= 1;
-            --siz;
-            ++addr;
-            ++mem;
-            ++beg;
+    unsigned long i;
+    for (i = 1; i < nsites; ++i) {
+        const struct tm_site* s = __atomic_load_n(g_tm_site + i, __ATOMIC_ACQUIRE);
+        if (!s) {
+            continue;
         }
+        if (count < n) {
+            site[count] = s;
+        }
+        ++count;
     }
+
+    return count;
 }
 
-int
-load_int(const int* addr)
+void
+tm_site_report(FILE* file)
 {
-    int value;
-    load((uintptr_t)addr, &value, sizeof(value));
-    return value;
+    unsigned long nsites = tm_sites(NULL, 0);
+
+    const struct tm_site** site = malloc(nsites * sizeof(*site));
+    if (nsites && !site) {
+        perror("malloc");
+        abort(); /* We cannot report; let's abort for now. */
+    }
+
+    unsigned long count = tm_sites(site, nsites);
+    if (count < nsites) {
+        nsites = count;
+    }
+
+    fprintf(file, "%-24s %-20s %10s %10s %7s %-12s %8s %10s %10s\n",
+            "function", "location", "commits", "aborts", "abort%",
+            "top-abort", "retries", "acquired", "written");
+
+    unsigned long i;
+    for (i = 0; i < nsites; ++i) {
+
+        struct tm_stats stats;
+        tm_site_stats_snapshot(site[i], &stats);
+
+        unsigned long aborts = 0;
+        unsigned long top_reason = 0;
+        unsigned long reason;
+        for (reason = 0; reason < TM_NABORT_REASONS; ++reason) {
+            aborts += stats.aborts[reason];
+            if (stats.aborts[reason] > stats.aborts[top_reason]) {
+                top_reason = reason;
+            }
+        }
+
+        unsigned long attempts = stats.commits + aborts;
+        unsigned long commits = stats.commits ? stats.commits : 1;
+
+        char location[64];
+        snprintf(location, sizeof(location), "%s:%lu",
+                 site[i]->file, site[i]->line);
+
+        /* Retries are the maximum per transaction; acquired
+         * and written are the averages per commit. */
+        fprintf(file, "%-24s %-20s %10lu %10lu %6.1f%% %-12s %8lu %10.1f %10.1f\n",
+                site[i]->func, location, stats.commits, aborts,
+                attempts ? 100.0 * aborts / attempts : 0.0,
+                aborts ? tm_abort_reason_name(top_reason) : "-",
+                stats.max_retries,
+                (double)stats.acquired / commits,
+                (double)stats.written_bytes / commits);
+    }
+
+    free(site);
 }
 
-void
-store_int(int* addr, int value)
+/* Returns the next chunk of the log, or NULL if the log is full. */
+static struct _tm_log_chunk*
+next_log_chunk(struct _tm_tx* tx)
 {
-    store((uintptr_t)addr, &value, sizeof(value));
+    struct _tm_log_chunk* chunk = tx->log_chunk;
+
+    if (chunk->next) {
+        return chunk->next;
+    }
+
+    if ((tx->log_nchunks + 2) * _TM_LOG_CHUNK_NENTRIES > TM_LOG_MAX_NENTRIES) {
+        return NULL;
+    }
+
+    struct _tm_log_chunk* next = malloc(sizeof(*next));
+    if (!next) {
+        return NULL;
+    }
+
+    next->prev = chunk;
+    next->next = NULL;
+    chunk->next = next;
+
+    ++tx->log_nchunks;
+
+    return next;
 }
 
 void
@@ -135,9 +337,32 @@ append_to_log(void (*apply)(uintptr_t),
 {
     struct _tm_tx* tx = _tm_get_tx();
 
-    assert(tx->log_length < arraylen(tx->log));
+    if (!tx->log_chunk) {
+        tx->log_chunk = &tx->log_first;
+    }
+
+    struct _tm_log_chunk* chunk = tx->log_chunk;
 
-    struct _tm_log_entry* entry = tx->log + tx->log_length;
+    if (tx->log_length == _TM_LOG_CHUNK_NENTRIES) {
+        chunk = next_log_chunk(tx);
+    }
+
+    if (!chunk || fault_inject(FAULT_LOG)) {
+        /* We cannot log the operation, so we revert it and
+         * let the transaction recover. */
+        if (undo) {
+            undo(data);
+        }
+        save_errno();
+        _tm_recover(ENOMEM, TM_ABORT_LOG_OVERFLOW); /* does not return */
+    }
+
+    if (chunk != tx->log_chunk) {
+        tx->log_chunk = chunk;
+        tx->log_length = 0;
+    }
+
+    struct _tm_log_entry* entry = tx->log_chunk->entry + tx->log_length;
 
     entry->apply = apply;
     entry->undo  = undo;
@@ -158,63 +383,191 @@ _tm_get_tx()
 bool
 _tm_begin(int value)
 {
-    return value != 2;
+    if (value == 2) {
+        return false;
+    }
+
+    struct _tm_tx* tx = _tm_get_tx();
+
+    uint64_t now = tsc_read();
+    if (!tx->nretries) {
+        tx->begin_tsc = now;
+    }
+    tx->attempt_tsc = now;
+    tx->active = true;
+
+    epoch_enter();
+
+    trace_record(TRACE_BEGIN, tx->nretries, 0);
+
+    _tm_engine_begin(tx);
+
+    return true;
 }
 
-static void
-release_resources(struct resource* beg,
-            const struct resource* end, bool commit)
+/* Returns the number of applied entries. */
+static unsigned long
+apply_log(struct _tm_tx* tx)
 {
-    while (beg < end) {
-        release_resource(beg, commit);
-        ++beg;
+    const struct _tm_log_chunk* chunk = &tx->log_first;
+
+    unsigned long nentries = 0;
+
+    while (true) {
+
+        const struct _tm_log_entry* beg = chunk->entry;
+        const struct _tm_log_entry* end = chunk == tx->log_chunk ?
+                                              beg + tx->log_length :
+                                              arrayend(chunk->entry);
+        nentries += end - beg;
+
+        while (beg < end) {
+            if (beg->apply) {
+                trace_record(TRACE_LOG_APPLY, (uintptr_t)beg->apply,
+                             (uintptr_t)beg->data);
+                beg->apply(beg->data);
+            }
+            ++beg;
+        }
+
+        if (chunk == tx->log_chunk) {
+            break;
+        }
+        chunk = chunk->next;
     }
+
+    return nentries;
 }
 
 static void
-apply_log(struct _tm_log_entry* beg, const struct _tm_log_entry* end)
+undo_log(struct _tm_tx* tx)
 {
-    while (beg < end) {
-        if (beg->apply) {
-            beg->apply(beg->data);
+    const struct _tm_log_chunk* chunk = tx->log_chunk;
+    unsigned long length = tx->log_length;
+
+    while (chunk) {
+
+        const struct _tm_log_entry* beg = chunk->entry;
+        const struct _tm_log_entry* end = beg + length;
+
+        while (end > beg) {
+            --end;
+            if (end->undo) {
+                trace_record(TRACE_LOG_UNDO, (uintptr_t)end->undo,
+                             (uintptr_t)end->data);
+                end->undo(end->data);
+            }
         }
-        ++beg;
+
+        chunk = chunk->prev;
+        length = _TM_LOG_CHUNK_NENTRIES;
     }
 }
 
+/* Empties the log and frees allocated chunks beyond the
+ * pooled ones. */
 static void
-undo_log(struct _tm_log_entry* beg, const struct _tm_log_entry* end)
+clear_log(struct _tm_tx* tx)
 {
-    while (end > beg) {
-        --end;
-        if (end->undo) {
-            end->undo(end->data);
+    if (tx->log_nchunks > TM_LOG_NPOOLED_CHUNKS) {
+
+        struct _tm_log_chunk* chunk = &tx->log_first;
+        unsigned long i;
+
+        for (i = 0; i < TM_LOG_NPOOLED_CHUNKS; ++i) {
+            chunk = chunk->next;
+        }
+
+        struct _tm_log_chunk* next = chunk->next;
+        chunk->next = NULL;
+
+        while (next) {
+            chunk = next;
+            next = next->next;
+            free(chunk);
         }
+
+        tx->log_nchunks = TM_LOG_NPOOLED_CHUNKS;
     }
+
+    tx->log_chunk = &tx->log_first;
+    tx->log_length = 0;
 }
 
 void
 _tm_commit()
 {
-    release_resources(arraybeg(g_resource),
-                      arrayend(g_resource), true);
-
     struct _tm_tx* tx = _tm_get_tx();
 
+    conflict_set_site(__builtin_return_address(0));
+
+    struct tm_stats* stats = _tm_thread_stats();
+
+    /* The engine adds to these counters; the differences
+     * are the transaction's footprint. */
+    unsigned long acquired = stats->acquired;
+    unsigned long written_bytes = stats->written_bytes;
+
+    _tm_engine_commit(tx);
+
+    unsigned long log_entries = 0;
+
     /* Perform logged operations */
-    apply_log(tx->log, tx->log + tx->log_length);
-    tx->log_length = 0;
+    if (tx->log_chunk) {
+        log_entries = apply_log(tx);
+        clear_log(tx);
+    }
+
+    epoch_leave();
+
+    trace_record(TRACE_COMMIT, tx->nretries, 0);
+
+    stats->log_entries += log_entries;
+    ++stats->commits;
+    if (tx->nretries > stats->max_retries) {
+        stats->max_retries = tx->nretries;
+    }
+
+    struct tm_stats* site_stats = thread_site_stats(tx->site);
+    site_stats->acquired      += stats->acquired - acquired;
+    site_stats->written_bytes += stats->written_bytes - written_bytes;
+    site_stats->log_entries   += log_entries;
+    ++site_stats->commits;
+    if (tx->nretries > site_stats->max_retries) {
+        site_stats->max_retries = tx->nretries;
+    }
+
+    struct histogram* hist = thread_histograms();
+    histogram_record(hist + TM_HIST_COMMIT_LATENCY, tsc_read() - tx->begin_tsc);
+    histogram_record(hist + TM_HIST_RETRIES, tx->nretries);
+
+    tx->nretries = 0;
+    tx->active = false;
 }
 
 static void
-rollback_tx(struct _tm_tx* tx, int value)
+rollback_tx(struct _tm_tx* tx, int value, enum tm_abort_reason reason)
 {
-    release_resources(arraybeg(g_resource),
-                      arrayend(g_resource), false);
+    tx->active = false;
+
+    trace_record(TRACE_ABORT, reason, 0);
+
+    ++_tm_thread_stats()->aborts[reason];
+    ++thread_site_stats(tx->site)->aborts[reason];
+    ++tx->nretries;
+
+    histogram_record(thread_histograms() + TM_HIST_ABORT_LATENCY,
+                     tsc_read() - tx->attempt_tsc);
+
+    _tm_engine_rollback(tx);
 
     /* Revert logged operations */
-    undo_log(tx->log, tx->log + tx->log_length);
-    tx->log_length = 0;
+    if (tx->log_chunk) {
+        undo_log(tx);
+        clear_log(tx);
+    }
+
+    epoch_leave();
 
     /* Restore errno */
     if (tx->errno_saved) {
@@ -227,19 +580,39 @@ rollback_tx(struct _tm_tx* tx, int value)
 }
 
 void
-tm_restart()
+_tm_restart(enum tm_abort_reason reason)
 {
-    rollback_tx(_tm_get_tx(), 1);
+    struct _tm_tx* tx = _tm_get_tx();
+
+    if (!tx->active) {
+        /* The recovery handler restarts a transaction that
+         * tm_recover() already rolled back. */
+        longjmp(tx->env, 1);
+    }
+
+    rollback_tx(tx, 1, reason);
 }
 
 void
-tm_recover(int errno_code)
+_tm_recover(int errno_code, enum tm_abort_reason reason)
 {
     struct _tm_tx* tx = _tm_get_tx();
 
     tx->recovery_errno_code = errno_code;
 
-    rollback_tx(tx, 2);
+    rollback_tx(tx, 2, reason);
+}
+
+void
+tm_restart()
+{
+    _tm_restart(TM_ABORT_RESTART);
+}
+
+void
+tm_recover(int errno_code)
+{
+    _tm_recover(errno_code, TM_ABORT_ERRNO);
 }
 
 int
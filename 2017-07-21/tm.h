@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 /* Log entry */
 struct _tm_log_entry {
@@ -23,6 +24,156 @@ struct _tm_log_entry {
     uintptr_t    data;
 };
 
+#define _TM_LOG_CHUNK_NENTRIES  (128)
+
+/* A chunk of log entries */
+struct _tm_log_chunk {
+    struct _tm_log_chunk* prev;
+    struct _tm_log_chunk* next;
+    struct _tm_log_entry  entry[_TM_LOG_CHUNK_NENTRIES];
+};
+
+/*
+ * Statistics
+ */
+
+/* Reasons for aborting a transaction */
+enum tm_abort_reason {
+    /* Another transaction owns or changed the accessed memory */
+    TM_ABORT_CONFLICT,
+    /* The accessed memory shares its slot with other memory; with
+     * the ownership engine, the resource table had to grow */
+    TM_ABORT_ALIAS,
+    /* tm_recover() */
+    TM_ABORT_ERRNO,
+    /* tm_restart() */
+    TM_ABORT_RESTART,
+    /* The log was full */
+    TM_ABORT_LOG_OVERFLOW,
+    TM_NABORT_REASONS
+};
+
+/**
+ * Returns a short name for an abort reason.
+ */
+static inline const char*
+tm_abort_reason_name(enum tm_abort_reason reason)
+{
+    /* No default label, so the compiler warns about new reasons. */
+    switch (reason) {
+        case TM_ABORT_CONFLICT:
+            return "conflict";
+        case TM_ABORT_ALIAS:
+            return "alias";
+        case TM_ABORT_ERRNO:
+            return "errno";
+        case TM_ABORT_RESTART:
+            return "restart";
+        case TM_ABORT_LOG_OVERFLOW:
+            return "log overflow";
+        case TM_NABORT_REASONS:
+            break;
+    }
+    return "unknown";
+}
+
+/**
+ * Transaction statistics of a thread, or of all threads
+ */
+struct tm_stats {
+    unsigned long commits;
+    unsigned long aborts[TM_NABORT_REASONS];
+    /* Largest number of aborts of a single committed transaction */
+    unsigned long max_retries;
+    /* Resources or locks acquired by committed transactions */
+    unsigned long acquired;
+    /* Log entries of committed transactions */
+    unsigned long log_entries;
+    /* Bytes written back by committed transactions */
+    unsigned long written_bytes;
+};
+
+/**
+ * Returns the sum of all threads' statistics. Threads only update
+ * their own counters, so the snapshot is not atomic.
+ */
+void
+tm_stats_snapshot(struct tm_stats* stats);
+
+/*
+ * Per-site statistics
+ */
+
+/**
+ * A transaction's location in the source code. tm_begin declares
+ * one for each transaction.
+ */
+struct tm_site {
+    const char*   file;
+    unsigned long line;
+    const char*   func;
+    /* Index of the site's statistics plus 1, or 0 before the
+     * first commit or abort */
+    unsigned long index;
+};
+
+/**
+ * Sums all threads' statistics of the transactions at site.
+ */
+void
+tm_site_stats_snapshot(const struct tm_site* site, struct tm_stats* stats);
+
+/**
+ * Stores up to n sites with statistics, and returns the number
+ * of all such sites.
+ */
+unsigned long
+tm_sites(const struct tm_site** site, unsigned long n);
+
+/**
+ * Prints commits, aborts, retries and footprint of each site.
+ */
+void
+tm_site_report(FILE* file);
+
+/*
+ * Latency histograms
+ */
+
+struct histogram;
+
+enum tm_histogram {
+    /* Time from the first start of a transaction to its commit */
+    TM_HIST_COMMIT_LATENCY,
+    /* Time of each aborted attempt */
+    TM_HIST_ABORT_LATENCY,
+    /* Aborts per committed transaction */
+    TM_HIST_RETRIES,
+    TM_NHISTOGRAMS
+};
+
+/**
+ * Percentiles of a histogram; latencies are in nanoseconds.
+ */
+struct tm_percentiles {
+    unsigned long count;
+    uint64_t      p50;
+    uint64_t      p99;
+    uint64_t      p999;
+    uint64_t      max;
+};
+
+/**
+ * Merges all threads' histograms of the given kind into hist.
+ * Latencies are in timestamp ticks; see tsc.h.
+ */
+void
+tm_histogram_snapshot(enum tm_histogram which, struct histogram* hist);
+
+void
+tm_histogram_percentiles(enum tm_histogram which,
+                         struct tm_percentiles* percentiles);
+
 /*
  * Transaction beginning and end
  */
@@ -32,13 +183,32 @@ struct _tm_log_entry {
 struct _tm_tx {
     jmp_buf env;
 
-    unsigned long        log_length;
-    struct _tm_log_entry log[256];
+    /* The log is a list of chunks, starting at log_first and ending
+     * at log_chunk, which holds log_length entries. Chunks after
+     * log_chunk are kept for later transactions. */
+    struct _tm_log_chunk  log_first;
+    struct _tm_log_chunk* log_chunk;
+    unsigned long         log_length;
+    unsigned long         log_nchunks;
 
     bool errno_saved;
     int errno_value;
 
     int recovery_errno_code;
+
+    /* True from the start of an attempt until its commit or
+     * rollback */
+    bool active;
+
+    /* Aborts of the current transaction */
+    unsigned long nretries;
+
+    /* Timestamps of the transaction's first and current attempt */
+    uint64_t begin_tsc;
+    uint64_t attempt_tsc;
+
+    /* Location of the current transaction */
+    struct tm_site* site;
 };
 
 struct _tm_tx*
@@ -50,17 +220,30 @@ _tm_begin(int value);
 void
 _tm_commit(void);
 
-#define tm_begin                                \
-    if (_tm_begin(setjmp(_tm_get_tx()->env)))   \
-    {
+#define tm_begin                                            \
+    {                                                       \
+        static struct tm_site _tm_site = {                  \
+            __FILE__, __LINE__, __func__, 0                 \
+        };                                                  \
+        struct _tm_tx* _tm_site_tx = _tm_get_tx();          \
+        _tm_site_tx->site = &_tm_site;                      \
+        if (_tm_begin(setjmp(_tm_site_tx->env)))            \
+        {
 
 #define tm_commit                           \
-        _tm_commit();                       \
-    } else {
+            _tm_commit();                   \
+        } else {
 
 #define tm_end  \
+        }       \
     }
 
+void
+_tm_restart(enum tm_abort_reason reason);
+
+void
+_tm_recover(int errno_code, enum tm_abort_reason reason);
+
 void
 tm_restart(void);
 
@@ -79,12 +262,24 @@ load(uintptr_t addr, void* buf, size_t siz);
 void
 store(uintptr_t addr, const void* buf, size_t siz);
 
-int
-load_int(const int* addr);
+/*
+ * Bulk copies; faster than load() and store() for large buffers
+ */
 
 void
-store_int(int* addr, int value);
+tm_load_range(uintptr_t addr, void* buf, size_t siz);
 
+void
+tm_store_range(uintptr_t addr, const void* buf, size_t siz);
+
+/* Typed accessors, such as tm_load_u64() and load_int(), are in
+ * tm-access.h. */
+
+/**
+ * Logs an operation of the current transaction. Apply runs on commit,
+ * undo runs on rollback. If the log exceeds TM_LOG_MAX_NENTRIES, the
+ * operation is undone and the transaction recovers with ENOMEM.
+ */
 void
 append_to_log(void (*apply)(uintptr_t),
               void (*undo)(uintptr_t), uintptr_t data);
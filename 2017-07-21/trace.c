@@ -0,0 +1,135 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "trace.h"
+
+#if defined(TM_TRACING)
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "thread.h"
+
+__thread struct trace_ring* t_trace_ring;
+
+/* Rings by thread id; the next thread with the same id reuses
+ * an exited thread's ring. */
+static struct trace_ring* g_trace_ring[NTHREADS];
+
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+
+static void
+dump_at_exit(void)
+{
+    const char* path = getenv("SIMPLETM_TRACE");
+
+    if (trace_dump(path) < 0) {
+        perror(path);
+    }
+}
+
+static void
+init_tracing(void)
+{
+    /* Calibrate now, so the dump doesn't take 10 ms at exit. */
+    tsc_ticks_per_ns();
+
+    if (getenv("SIMPLETM_TRACE")) {
+        atexit(dump_at_exit);
+    }
+}
+
+struct trace_ring*
+_trace_ring_slow()
+{
+    int err = pthread_once(&g_trace_once, init_tracing);
+    if (err) {
+        errno = err;
+        perror("pthread_once");
+        abort();
+    }
+
+    unsigned long self = thread_id();
+
+    struct trace_ring* ring = g_trace_ring[self];
+
+    if (!ring) {
+        ring = calloc(1, sizeof(*ring));
+        if (!ring) {
+            perror("calloc");
+            abort(); /* We cannot trace; let's abort for now. */
+        }
+        ring->thread = self;
+        __atomic_store_n(g_trace_ring + self, ring, __ATOMIC_RELEASE);
+    }
+
+    t_trace_ring = ring;
+
+    return ring;
+}
+
+int
+trace_dump(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    struct trace_header header = {
+        .magic = TRACE_MAGIC,
+        .tsc_ticks_per_ns = tsc_ticks_per_ns(),
+        .nrecords = 0
+    };
+
+    /* Write the header again once we know the number of records. */
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        goto err_fwrite;
+    }
+
+    unsigned long i;
+    for (i = 0; i < NTHREADS; ++i) {
+
+        const struct trace_ring* ring =
+            __atomic_load_n(g_trace_ring + i, __ATOMIC_ACQUIRE);
+        if (!ring) {
+            continue;
+        }
+
+        /* Records might be overwritten while we copy them; the
+         * tracer doesn't stop running threads. */
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = head > TRACE_NRECORDS ? head - TRACE_NRECORDS : 0;
+
+        for (; tail < head; ++tail) {
+            const struct trace_record* record =
+                ring->record + (tail & (TRACE_NRECORDS - 1));
+            if (fwrite(record, sizeof(*record), 1, file) != 1) {
+                goto err_fwrite;
+            }
+            ++header.nrecords;
+        }
+    }
+
+    if (fseek(file, 0, SEEK_SET) ||
+        (fwrite(&header, sizeof(header), 1, file) != 1)) {
+        goto err_fwrite;
+    }
+
+    return fclose(file) ? -1 : 0;
+
+err_fwrite:
+    fclose(file);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,128 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "tsc.h"
+
+/*
+ * Event tracer
+ *
+ * Build with 'make TM_TRACING=1' to record transaction events. Each
+ * thread writes fixed-size records into its own ring buffer of
+ * TRACE_NRECORDS records, overwriting the oldest ones; recording
+ * takes no locks. If the environment variable SIMPLETM_TRACE names a
+ * file, the rings are dumped to that file at exit. Convert dumps to
+ * Chrome trace JSON with 'trace2json < dump > trace.json'.
+ *
+ * Without TM_TRACING, trace_record() is empty and inline.
+ */
+
+#define TRACE_NRECORDS_BITSHIFT (16)
+#define TRACE_NRECORDS          (1ul << TRACE_NRECORDS_BITSHIFT)
+
+#define TRACE_MAGIC             (0x3130454341525453ul) /* "STRACE01" */
+
+enum trace_event {
+    /* arg0: retries so far */
+    TRACE_BEGIN,
+    /* arg0: base address, arg1: slot */
+    TRACE_ACQUIRE,
+    /* arg0: base address or 0, arg1: owner thread or 0 */
+    TRACE_CONFLICT,
+    /* arg0: enum tm_abort_reason */
+    TRACE_ABORT,
+    /* arg0: retries */
+    TRACE_COMMIT,
+    /* arg0: bytes written back, arg1: number of resources or stripes */
+    TRACE_WRITE_BACK,
+    /* arg0: function, arg1: data */
+    TRACE_LOG_APPLY,
+    /* arg0: function, arg1: data */
+    TRACE_LOG_UNDO,
+    TRACE_NEVENTS
+};
+
+/**
+ * A trace record
+ */
+struct trace_record {
+    uint64_t tsc;
+    uint64_t arg0;
+    uint64_t arg1;
+    uint32_t thread;
+    uint16_t event;
+    uint16_t reserved;
+};
+
+/**
+ * Header of a dump, followed by nrecords records, ordered by thread
+ * and time.
+ */
+struct trace_header {
+    uint64_t magic;
+    double   tsc_ticks_per_ns;
+    uint64_t nrecords;
+};
+
+#if defined(TM_TRACING)
+
+/**
+ * A thread's ring buffer
+ */
+struct trace_ring {
+    uint64_t            head;
+    uint32_t            thread;
+    struct trace_record record[TRACE_NRECORDS];
+};
+
+/* Don't use directly; call trace_record() instead. */
+extern __thread struct trace_ring* t_trace_ring;
+
+struct trace_ring*
+_trace_ring_slow(void);
+
+static inline void
+trace_record(enum trace_event event, uint64_t arg0, uint64_t arg1)
+{
+    struct trace_ring* ring = t_trace_ring;
+
+    if (__builtin_expect(!ring, 0)) {
+        ring = _trace_ring_slow();
+    }
+
+    uint64_t head = ring->head;
+
+    struct trace_record* record = ring->record + (head & (TRACE_NRECORDS - 1));
+    record->tsc    = tsc_read();
+    record->arg0   = arg0;
+    record->arg1   = arg1;
+    record->thread = ring->thread;
+    record->event  = event;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Writes the contents of all rings to a file. Returns 0 on success,
+ * or -1 with errno set on errors.
+ */
+int
+trace_dump(const char* path);
+
+#else
+
+static inline void
+trace_record(enum trace_event event, uint64_t arg0, uint64_t arg1)
+{ }
+
+#endif
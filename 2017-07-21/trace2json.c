@@ -0,0 +1,194 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+/*
+ * Converts a dump of the event tracer to Chrome trace JSON, which
+ * chrome://tracing and Perfetto display. Transactions become
+ * duration events from begin to commit or abort; all other
+ * events are instant events.
+ *
+ * Usage: trace2json [DUMP] > trace.json
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "thread.h"
+#include "tm.h"
+#include "trace.h"
+
+static const char*
+abort_reason_name(uint64_t reason)
+{
+    if (reason >= TM_NABORT_REASONS) {
+        return "unknown";
+    }
+    return tm_abort_reason_name(reason);
+}
+
+/* Threads with an open transaction. Once a ring wraps, a thread's
+ * first end event might have lost its begin event. */
+static bool g_open[NTHREADS];
+
+/* Returns true if the record belongs into the trace. */
+static bool
+is_balanced(const struct trace_record* record)
+{
+    if (record->thread >= NTHREADS) {
+        return true;
+    }
+
+    bool* open = g_open + record->thread;
+
+    switch (record->event) {
+        case TRACE_BEGIN:
+            *open = true;
+            return true;
+        case TRACE_ABORT:
+        case TRACE_COMMIT:
+            if (!*open) {
+                return false;
+            }
+            *open = false;
+            return true;
+        default:
+            return true;
+    }
+}
+
+static void
+print_record(FILE* out, const struct trace_record* record,
+             uint64_t tsc0, double ticks_per_us)
+{
+    double ts = (record->tsc - tsc0) / ticks_per_us;
+
+    fprintf(out, "{\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%.3f,",
+            record->thread, ts);
+
+    switch (record->event) {
+        case TRACE_BEGIN:
+            fprintf(out, "\"ph\":\"B\",\"name\":\"tx\","
+                         "\"args\":{\"retries\":%" PRIu64 "}}",
+                    record->arg0);
+            break;
+        case TRACE_ACQUIRE:
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"acquire\","
+                         "\"args\":{\"base\":\"0x%" PRIx64 "\","
+                         "\"slot\":%" PRIu64 "}}",
+                    record->arg0, record->arg1);
+            break;
+        case TRACE_CONFLICT:
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"conflict\","
+                         "\"args\":{\"base\":\"0x%" PRIx64 "\","
+                         "\"owner\":%" PRIu64 "}}",
+                    record->arg0, record->arg1);
+            break;
+        case TRACE_ABORT:
+            fprintf(out, "\"ph\":\"E\",\"name\":\"tx\","
+                         "\"args\":{\"abort\":\"%s\"}}",
+                    abort_reason_name(record->arg0));
+            break;
+        case TRACE_COMMIT:
+            fprintf(out, "\"ph\":\"E\",\"name\":\"tx\","
+                         "\"args\":{\"commit\":true}}");
+            break;
+        case TRACE_WRITE_BACK:
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"write-back\","
+                         "\"args\":{\"bytes\":%" PRIu64 ","
+                         "\"resources\":%" PRIu64 "}}",
+                    record->arg0, record->arg1);
+            break;
+        case TRACE_LOG_APPLY:
+        case TRACE_LOG_UNDO:
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\","
+                         "\"args\":{\"func\":\"0x%" PRIx64 "\","
+                         "\"data\":\"0x%" PRIx64 "\"}}",
+                    record->event == TRACE_LOG_APPLY ? "apply" : "undo",
+                    record->arg0, record->arg1);
+            break;
+        default:
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"event %u\"}",
+                    record->event);
+            break;
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    FILE* in = stdin;
+
+    if (argc > 1) {
+        in = fopen(argv[1], "rb");
+        if (!in) {
+            perror(argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct trace_header header;
+
+    if ((fread(&header, sizeof(header), 1, in) != 1) ||
+        (header.magic != TRACE_MAGIC)) {
+        fprintf(stderr, "not a trace dump\n");
+        return EXIT_FAILURE;
+    }
+
+    struct trace_record* record = malloc(header.nrecords * sizeof(*record));
+    if (header.nrecords && !record) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    if (fread(record, sizeof(*record), header.nrecords, in) != header.nrecords) {
+        fprintf(stderr, "truncated trace dump\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Timestamps start at the earliest record. */
+    uint64_t tsc0 = UINT64_MAX;
+    uint64_t i;
+
+    for (i = 0; i < header.nrecords; ++i) {
+        if (record[i].tsc < tsc0) {
+            tsc0 = record[i].tsc;
+        }
+    }
+
+    double ticks_per_us = header.tsc_ticks_per_ns * 1000;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    const char* separator = "";
+
+    for (i = 0; i < header.nrecords; ++i) {
+        if (!is_balanced(record + i)) {
+            continue;
+        }
+        printf("%s", separator);
+        print_record(stdout, record + i, tsc0, ticks_per_us);
+        separator = ",\n";
+    }
+
+    printf("\n");
+
+    printf("]}\n");
+
+    free(record);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    return EXIT_SUCCESS;
+}
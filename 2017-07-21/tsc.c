@@ -0,0 +1,58 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#include "tsc.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double         g_tsc_ticks_per_ns = 1;
+static pthread_once_t g_tsc_once = PTHREAD_ONCE_INIT;
+
+static uint64_t
+monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static void
+calibrate_tsc(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint64_t ns_beg = monotonic_ns();
+    uint64_t tsc_beg = tsc_read();
+
+    uint64_t ns_end;
+    do {
+        ns_end = monotonic_ns();
+    } while (ns_end - ns_beg < 10000000ul);
+
+    uint64_t tsc_end = tsc_read();
+
+    g_tsc_ticks_per_ns = (double)(tsc_end - tsc_beg) / (ns_end - ns_beg);
+#endif
+}
+
+double
+tsc_ticks_per_ns()
+{
+    int err = pthread_once(&g_tsc_once, calibrate_tsc);
+    if (err) {
+        errno = err;
+        perror("pthread_once");
+        abort();
+    }
+
+    return g_tsc_ticks_per_ns;
+}
@@ -0,0 +1,41 @@
+/* This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The person who associated a work with this deed has dedicated the
+ * work to the public domain by waiving all of his or her rights to
+ * the work worldwide under copyright law, including all related and
+ * neighboring rights, to the extent allowed by law. You can copy,
+ * modify, distribute and perform the work, even for commercial
+ * purposes, all without asking permission.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Cheap timestamps
+ *
+ * On x86, timestamps are TSC ticks; elsewhere, they are nanoseconds
+ * of CLOCK_MONOTONIC.
+ */
+
+static inline uint64_t
+tsc_read(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Returns the number of timestamp ticks per nanosecond. The first
+ * call calibrates the TSC for 10 ms.
+ */
+double
+tsc_ticks_per_ns(void);